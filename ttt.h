@@ -4,13 +4,18 @@
   Created on     : May  21, 2011
   Description    : Common header file for tttclient/tttserver
 
-  Notes          : The message struct contains the names of two private FIFOs -
+  Notes          : The handshake contains the names of two private FIFOs -
                    one that the client reads and one that it writes. The one
-                   named client_in_fifo is the one it reads. 
+                   named client_in_fifo is the one it reads. The structs are
+                   the decoded form of the frames of tttproto.h; they are
+                   never written to a FIFO or socket as they are.
   Based on	 : upcased.h  written by S. Weiss
  
 ******************************************************************************/
 
+#ifndef TTT_H
+#define TTT_H
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -27,10 +32,14 @@
 
 #define MY_NAME		"AGOLTSEV"
 #define PUBLIC        "/tmp/TICTACTOE_AGOLTSEV"
-#define HALFPIPE_BUF  (PIPE_BUF/2)
+#define SOCKET_PATH   "/tmp/TICTACTOE_AGOLTSEV.sock"	//see tttsock.h
+#define MAX_FIFO_NAME 255	//longest private FIFO name in a hello
+#define WELCOME_MS    10000	//a FIFO client waits this long for the welcome
 
 #define STATUS_OK	0
 #define INVALID_MOVE    -1
+#define INVALID_BOARD   -2	//the board negotiated in the handshake is not supported
+#define SERVER_BUSY	-3	//the server turns the session away, see tttadmit.h
 #define TIED		1
 #define CLIENT_WINS	2
 #define SERVER_WINS	3
@@ -39,22 +48,32 @@
 #define EMPTY_CELL	' '
 #define X_CELL 		'X'
 #define O_CELL		'O'
-#define BOARD_SIZE 3
+#define BOARD_SIZE 3		//default board is BOARD_SIZE x BOARD_SIZE
+#define WIN_LENGTH 3		//default number of pieces in a row to win
+#define MAX_BOARD_SIZE 16	//see TG_MAX_SIDE in tttgrid.h
+
+#define ENGINE_SEARCH	0	//alpha-beta, see tttsearch.h and tttdeep.h
+#define ENGINE_MCTS	1	//Monte Carlo tree search, see tttmcts.h
+
+#define TRANSPORT_STREAM 0	//moves travel on the FIFOs or the socket
+#define TRANSPORT_RING	1	//moves travel on shared-memory rings, see tttring.h
 
 typedef int ttt_type;
 
 
 
-/*
- Because the message must be no larger than PIPE_BUF bytes, and because we
- should be flexible enough to allow FIFO pathnames of a large size, the 
- struct is split equally between the length of the two FIFO names.
-*/
 struct handshake {
+    int version;                  //of the client's protocol, see tttproto.h
     int client_char;
     int server_char;		
-    char   client_in_fifo [HALFPIPE_BUF]; //client's incomming fifo
-    char   client_out_fifo[HALFPIPE_BUF]; //client's outgoing fifo
+    int level;                    //server's strength, see tttsearch.h
+    int rows;                     //board geometry, 0 means BOARD_SIZE
+    int cols;
+    int win_len;                  //pieces in a row to win, 0 means WIN_LENGTH
+    int engine;                   //ENGINE_SEARCH or ENGINE_MCTS
+    int transport;                //TRANSPORT_STREAM or TRANSPORT_RING (socket only)
+    char   client_in_fifo [MAX_FIFO_NAME + 1]; //client's incomming fifo
+    char   client_out_fifo[MAX_FIFO_NAME + 1]; //client's outgoing fifo
 };
 
 
@@ -64,4 +83,4 @@ struct move {
     int   col;
 };
 
-
+#endif
@@ -0,0 +1,171 @@
+/******************************************************************************
+  Title          : tttadmit.c
+  Author         : Andriy Goltsev
+  Description    : Token buckets, the queue of waiting clients, busy replies
+
+  Notes          : The buckets live in an open-addressed table of AD_UIDS
+                   entries probed AD_PROBES deep; a user that finds no
+                   entry takes the probed one idle the longest, which then
+                   starts full again. The queue is a ring of
+                   ad_queue_max clients. Only the process that takes the
+                   hellos uses either, so neither is shared or locked.
+
+******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include "tttadmit.h"
+#include "tttproto.h"
+#include "tttsock.h"
+#include "tttstats.h"
+#include "tttsuper.h"
+
+#define AD_PROBES	8
+#define AD_ANYONE	((uid_t) -1)	// the bucket of the clients of no known user
+
+struct bucket {
+	uid_t uid;
+	int used;
+	double tokens;
+	long long last_ms;	// when tokens was last filled up
+};
+
+int ad_max_sessions;
+int ad_queue_max = AD_QUEUE;
+double ad_uid_rate;
+
+static struct bucket _buckets[AD_UIDS];
+static struct ad_client* _queue;
+static int _head, _waiting;
+
+int ad_init(void)
+{
+	if (ad_max_sessions > 0 && ad_queue_max > 0 &&
+	    (_queue = calloc(ad_queue_max, sizeof(*_queue))) == NULL)
+		return -1;
+	return 0;
+}
+
+int ad_waiting(void)
+{
+	return _waiting;
+}
+
+//the user whose bucket the client takes a token of
+static uid_t client_uid(const struct ad_client* c)
+{
+	struct stat in, out;
+
+	if (c->fd != -1)
+		return us_peer_uid(c->fd);
+	// the names are the client's word: anything but two FIFOs of one
+	// user, links to them included, counts for nobody in particular
+	if (lstat(c->hello.client_in_fifo, &in) == -1 || lstat(c->hello.client_out_fifo, &out) == -1 ||
+	    !S_ISFIFO(in.st_mode) || !S_ISFIFO(out.st_mode) || in.st_uid != out.st_uid)
+		return AD_ANYONE;
+	return out.st_uid;
+}
+
+//takes a token of the client's user; returns 0 if there is none
+static int take_token(uid_t uid, long long now)
+{
+	struct bucket *b, *oldest = NULL;
+	double burst = ad_uid_rate * AD_BURST_S < 1 ? 1 : ad_uid_rate * AD_BURST_S;
+	int i;
+
+	for (i = 0; i < AD_PROBES; i++) {
+		b = &_buckets[(uid * 2654435761u + i) % AD_UIDS];
+		if (b->used && b->uid == uid)
+			break;
+		if (oldest == NULL || !b->used || (oldest->used && b->last_ms < oldest->last_ms))
+			oldest = b;
+	}
+	if (i == AD_PROBES) {
+		b = oldest;
+		b->uid = uid;
+		b->used = 1;
+		b->tokens = burst;
+		b->last_ms = now;
+	}
+	b->tokens += (now - b->last_ms) * ad_uid_rate / 1000;
+	if (b->tokens > burst)
+		b->tokens = burst;
+	b->last_ms = now;
+	if (b->tokens < 1)
+		return 0;
+	b->tokens -= 1;
+	return 1;
+}
+
+//answers the client with SERVER_BUSY and lets it go
+static void busy(const struct ad_client* c)
+{
+	struct tp_welcome w;
+	unsigned char frame[TP_WELCOME_BYTES], hello[TP_BUFFER];
+	int fd, len, i, passed[US_MAX_FDS];
+
+	memset(&w, 0, sizeof(w));
+	w.version = c->fd == -1 && c->hello.version < TP_VERSION ? c->hello.version : TP_VERSION;
+	w.status = SERVER_BUSY;
+	w.max_side = MAX_BOARD_SIZE;
+	len = tp_put_welcome(frame, &w);
+	if (c->fd != -1) {
+		send(c->fd, frame, len, MSG_DONTWAIT | MSG_NOSIGNAL);
+		// closing a socket with unread messages resets the connection,
+		// and the client would never read its welcome
+		fcntl(c->fd, F_SETFL, fcntl(c->fd, F_GETFL) | O_NONBLOCK);
+		while (us_recv_fds(c->fd, hello, sizeof(hello), passed, US_MAX_FDS) > 0)
+			for (i = 0; i < US_MAX_FDS; i++)
+				if (passed[i] != -1)
+					close(passed[i]);
+		close(c->fd);
+	}
+	else if ((fd = tp_open_fifo(c->hello.client_in_fifo, O_WRONLY | O_NONBLOCK)) != -1) {
+		write(fd, frame, len);	// one frame, atomic
+		close(fd);
+	}
+	st_count(ST_BUSY, 1);
+}
+
+enum ad_verdict ad_admit(const struct ad_client* c, int active)
+{
+	long long now = sv_now_ms();
+
+	if (ad_uid_rate > 0 && !take_token(client_uid(c), now)) {
+		busy(c);
+		return AD_BUSY;
+	}
+	if (ad_max_sessions <= 0 || (active < ad_max_sessions && _waiting == 0))
+		return AD_ADMIT;
+	if (_waiting == ad_queue_max) {
+		busy(c);
+		return AD_BUSY;
+	}
+	_queue[(_head + _waiting) % ad_queue_max] = *c;
+	_queue[(_head + _waiting) % ad_queue_max].queued_ms = now;
+	_waiting++;
+	st_count(ST_QUEUED, 1);
+	return AD_QUEUED;
+}
+
+int ad_dequeue(struct ad_client* c, int active)
+{
+	long long now = sv_now_ms();
+
+	while (_waiting > 0 && now - _queue[_head].queued_ms >= AD_WAIT_MS) {
+		busy(&_queue[_head]);
+		_head = (_head + 1) % ad_queue_max;
+		_waiting--;
+	}
+	if (_waiting == 0 || active >= ad_max_sessions)
+		return 0;
+	*c = _queue[_head];
+	_head = (_head + 1) % ad_queue_max;
+	_waiting--;
+	return 1;
+}
@@ -0,0 +1,78 @@
+/******************************************************************************
+  Title          : tttadmit.h
+  Author         : Andriy Goltsev
+  Description    : Admission control of new sessions
+
+  Notes          : Every new client passes through ad_admit() before the
+                   server starts its session, in whichever process takes
+                   the hellos: the forking server, the event loop (-e) or
+                   the dispatcher of the pool (-w). Three limits apply:
+
+                   - each user has a token bucket filled at ad_uid_rate
+                     sessions a second, holding up to AD_BURST_S seconds
+                     of them; a client whose user has no token left is
+                     turned away at once. The user of a socket client is
+                     the peer's, from SO_PEERCRED, and only that one can
+                     be trusted. The user of a FIFO client is the owner of
+                     the two FIFOs its hello names, if they are FIFOs of
+                     one user; the clients whose are not share a bucket.
+                     A FIFO client may still name FIFOs another user made
+                     and spend that user's tokens.
+                   - with ad_max_sessions sessions running, a new client
+                     waits in a queue of ad_queue_max, oldest first, until
+                     one ends. Past AD_WAIT_MS in the queue it is turned
+                     away, and so is one that finds the queue full.
+
+                   Turned away means it gets a welcome (tttproto.h) with
+                   status SERVER_BUSY and its connection is closed, so it
+                   never hangs on a server that will not play it. The
+                   limits are off (0) unless set with -S, -Q and -u.
+
+******************************************************************************/
+
+#ifndef TTTADMIT_H
+#define TTTADMIT_H
+
+#include <sys/types.h>
+#include "ttt.h"
+
+#define AD_QUEUE	128	// default queue length
+#define AD_WAIT_MS	1000	// longest wait in the queue
+#define AD_POLL_MS	10	// interval of queue checks while clients wait
+#define AD_BURST_S	2	// seconds of tokens a bucket holds
+#define AD_UIDS		1024	// users with a bucket at once
+
+enum ad_verdict {
+	AD_ADMIT,		// start the session now
+	AD_QUEUED,		// kept until ad_dequeue() returns it
+	AD_BUSY			// turned away
+};
+
+// a new client: a hello from the public FIFO or a connection not read yet
+struct ad_client {
+	int fd;			// the connection, or -1 for a FIFO client
+	struct handshake hello;	// of a FIFO client
+	long long since;	// st_now() when it came
+	long long queued_ms;	// sv_now_ms() when it was queued
+};
+
+extern int ad_max_sessions;	// 0: no limit
+extern int ad_queue_max;
+extern double ad_uid_rate;	// sessions a second per user, 0: no limit
+
+//allocates the queue; returns -1 if it cannot
+int ad_init(void);
+
+//decides on a new client while active sessions run; a queued one is copied
+//and a busy one has been answered and closed already
+enum ad_verdict ad_admit(const struct ad_client* c, int active);
+
+//clients waiting in the queue
+int ad_waiting(void);
+
+//turns away the clients that waited too long; then fills in c with the
+//next queued client and returns 1 if one may start while active sessions
+//run, 0 otherwise
+int ad_dequeue(struct ad_client* c, int active);
+
+#endif
@@ -0,0 +1,197 @@
+/******************************************************************************
+  Title          : tttbatch.c
+  Author         : Andriy Goltsev
+  Description    : Batches of boards, their geometry and the kernel dispatch
+
+  Notes          : The kernels handle whole groups of their width; the
+                   boards left at the end of a batch go through the scalar
+                   one. The arrays of a batch are aligned to cache lines.
+
+******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "ttt.h"
+#include "tttbatch.h"
+
+typedef int (*bt_kernel_fn)(const struct bt_batch* b, int from, int to, signed char* status,
+			    uint64_t* legal);
+
+#define BT_NAME		eval_scalar
+#define BT_GROUP	group_scalar
+#define BT_TARGET
+#define BT_V		uint64_t
+#define BT_L		1
+#define BT_LANE(v, l)	(v)
+#define BT_MASK(v)	(-(uint64_t) ((v) != 0))
+#include "tttbatch.inc"
+#undef BT_NAME
+#undef BT_GROUP
+#undef BT_TARGET
+#undef BT_V
+#undef BT_L
+#undef BT_LANE
+#undef BT_MASK
+
+#if defined(__x86_64__) || defined(__i386__)
+typedef uint64_t bt_v2 __attribute__((vector_size(16)));
+typedef uint64_t bt_v4 __attribute__((vector_size(32)));
+
+#define BT_NAME		eval_sse2
+#define BT_GROUP	group_sse2
+#define BT_TARGET	__attribute__((target("sse2")))
+#define BT_V		bt_v2
+#define BT_L		2
+#define BT_LANE(v, l)	((v)[l])
+#define BT_MASK(v)	((bt_v2) ((v) != 0))
+#include "tttbatch.inc"
+#undef BT_NAME
+#undef BT_GROUP
+#undef BT_TARGET
+#undef BT_V
+#undef BT_L
+#undef BT_MASK
+
+#define BT_NAME		eval_avx2
+#define BT_GROUP	group_avx2
+#define BT_TARGET	__attribute__((target("avx2")))
+#define BT_V		bt_v4
+#define BT_L		4
+#define BT_MASK(v)	((bt_v4) ((v) != 0))
+#include "tttbatch.inc"
+#endif
+
+static const struct {
+	const char* name;
+	bt_kernel_fn eval;
+} _kernels[] = {
+#if defined(__x86_64__) || defined(__i386__)
+	{ "avx2", eval_avx2 },
+	{ "sse2", eval_sse2 },
+#endif
+	{ "scalar", eval_scalar },
+};
+#define BT_KERNELS	(int) (sizeof(_kernels) / sizeof(_kernels[0]))
+
+static int _kernel = -1;	// in _kernels, chosen on first use
+
+static int supported(const char* name)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_cpu_init();
+	if (strcmp(name, "avx2") == 0)
+		return __builtin_cpu_supports("avx2");
+	if (strcmp(name, "sse2") == 0)
+		return __builtin_cpu_supports("sse2");
+#endif
+	return strcmp(name, "scalar") == 0;
+}
+
+int bt_use(const char* name)
+{
+	int i;
+
+	for (i = 0; i < BT_KERNELS; i++)
+		if (strcmp(_kernels[i].name, name) == 0 && supported(name)) {
+			_kernel = i;
+			return 0;
+		}
+	return -1;
+}
+
+//the widest kernel this machine runs
+static int best(void)
+{
+	int i;
+
+	for (i = 0; i < BT_KERNELS - 1 && !supported(_kernels[i].name); i++)
+		;
+	return i;
+}
+
+const char* bt_kernel(void)
+{
+	if (_kernel == -1)
+		_kernel = best();
+	return _kernels[_kernel].name;
+}
+
+//the cells of g a line of k may start from going dr rows and dc columns a
+//step; returns 0 if there are none
+static int line_starts(struct bt_geometry* g, int dr, int dc, tg_bits* start)
+{
+	int r, c, any = 0;
+
+	memset(start, 0, sizeof(*start));
+	for (r = 0; r < g->rows; r++)
+		for (c = 0; c < g->cols; c++)
+			if (r + (g->k - 1) * dr < g->rows &&
+			    c + (g->k - 1) * dc >= 0 && c + (g->k - 1) * dc < g->cols) {
+				tg_set(start, r * g->cols + c);
+				any = 1;
+			}
+	return any;
+}
+
+int bt_init(struct bt_batch* b, int rows, int cols, int k, int size)
+{
+	static const int dirs[4][2] = { { 0, 1 }, { 1, 0 }, { 1, 1 }, { 1, -1 } };
+	struct bt_geometry* g = &b->geom;
+	struct ttt_grid grid;
+	int d;
+
+	if (tg_init(&grid, rows, cols, k) == -1 || size < 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	g->rows = rows;
+	g->cols = cols;
+	g->k = k;
+	g->words = (rows * cols + 63) / 64;
+	g->all = grid.all;
+	g->ndirs = 0;
+	for (d = 0; d < 4; d++)
+		if (line_starts(g, dirs[d][0], dirs[d][1], &g->start[g->ndirs]))
+			g->step[g->ndirs++] = dirs[d][0] * cols + dirs[d][1];
+	b->n = 0;
+	b->size = (size + BT_LANES - 1) / BT_LANES * BT_LANES;
+	b->side[TB_SERVER] = aligned_alloc(64, (b->size * g->words * sizeof(uint64_t) + 63) / 64 * 64);
+	b->side[TB_CLIENT] = aligned_alloc(64, (b->size * g->words * sizeof(uint64_t) + 63) / 64 * 64);
+	if (b->side[TB_SERVER] == NULL || b->side[TB_CLIENT] == NULL) {
+		bt_free(b);
+		return -1;
+	}
+	return 0;
+}
+
+void bt_free(struct bt_batch* b)
+{
+	free(b->side[TB_SERVER]);
+	free(b->side[TB_CLIENT]);
+	b->side[TB_SERVER] = b->side[TB_CLIENT] = NULL;
+	b->n = b->size = 0;
+}
+
+int bt_add(struct bt_batch* b, const struct ttt_grid* g)
+{
+	int w;
+
+	if (b->n == b->size)
+		return -1;
+	for (w = 0; w < b->geom.words; w++) {
+		b->side[TB_SERVER][w * b->size + b->n] = g->side[TB_SERVER].w[w];
+		b->side[TB_CLIENT][w * b->size + b->n] = g->side[TB_CLIENT].w[w];
+	}
+	return b->n++;
+}
+
+void bt_eval(const struct bt_batch* b, signed char* status, uint64_t* legal)
+{
+	int i;
+
+	if (_kernel == -1)
+		_kernel = best();
+	i = _kernels[_kernel].eval(b, 0, b->n, status, legal);
+	eval_scalar(b, i, b->n, status, legal);
+}
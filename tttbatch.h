@@ -0,0 +1,81 @@
+/******************************************************************************
+  Title          : tttbatch.h
+  Author         : Andriy Goltsev
+  Description    : ttt_status() and the legal moves of many boards at once
+
+  Notes          : A batch holds boards of one geometry packed as a struct
+                   of arrays: word w of the pieces of side s on board i is
+                   side[s][w * size + i], so the words the kernels load
+                   together belong to consecutive boards and one SIMD lane
+                   holds one board. Nothing is incremental here, unlike
+                   tg_apply(): a k-in-a-row is found from the pieces alone,
+                   for each of the four directions by
+                   run = pieces & (run >> step) taken k - 1 times and
+                   masked with the cells a line of k can start from.
+
+                   The kernel is chosen once, at run time: AVX2 (4 boards
+                   an instruction), SSE2 (2) or plain 64-bit words on other
+                   machines. All three are the same source, tttbatch.inc,
+                   compiled for each target. bt_use() forces one, to
+                   compare them.
+
+******************************************************************************/
+
+#ifndef TTTBATCH_H
+#define TTTBATCH_H
+
+#include <stdint.h>
+#include "tttgrid.h"
+
+#define BT_LANES	4	// boards of the widest kernel, size is a multiple
+
+struct bt_geometry {
+	int rows, cols, k;
+	int words;		// of a board, 1 up to 64 cells
+	int ndirs;		// directions a line of k fits in
+	int step[4];		// cells between neighbours in each of them
+	tg_bits start[4];	// cells a line of k may start from
+	tg_bits all;		// every cell of the board
+};
+
+struct bt_batch {
+	struct bt_geometry geom;
+	int n, size;		// boards added, room
+	uint64_t* side[2];	// TB_SERVER and TB_CLIENT, see above
+};
+
+//makes room for size boards of rows x cols with k in a row; returns -1 with
+//errno set if the geometry is invalid or there is no memory
+int bt_init(struct bt_batch* b, int rows, int cols, int k, int size);
+
+//releases the arrays of the batch
+void bt_free(struct bt_batch* b);
+
+//empties the batch keeping its geometry
+static inline void bt_clear(struct bt_batch* b){
+	b->n = 0;
+}
+
+//appends the position of g, which must have the batch's geometry; returns
+//its index or -1 if the batch is full
+int bt_add(struct bt_batch* b, const struct ttt_grid* g);
+
+//sets status[i] to what ttt_status() says of board i: STATUS_OK, TIED,
+//CLIENT_WINS or SERVER_WINS. Unless legal is NULL, it gets the empty cells
+//of every board in the layout of side[], as words * size words
+void bt_eval(const struct bt_batch* b, signed char* status, uint64_t* legal);
+
+//1 if cell is empty on board i in the legal masks of bt_eval(); the
+//validMove() of the batch, once the cell is known to be on the board
+static inline int bt_is_legal(const struct bt_batch* b, const uint64_t* legal, int i, int cell){
+	return (legal[(cell >> 6) * b->size + i] >> (cell & 63)) & 1;
+}
+
+//name of the kernel bt_eval() uses: "avx2", "sse2" or "scalar"
+const char* bt_kernel(void);
+
+//makes bt_eval() use the kernel called name; returns -1 if this machine
+//cannot run it
+int bt_use(const char* name);
+
+#endif
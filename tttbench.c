@@ -0,0 +1,424 @@
+/******************************************************************************
+  Title          : tttbench.c
+  Author         : Andriy Goltsev
+  Description    : Headless load generator for tttserver
+
+  Build with     : make tttbench
+
+  Usage          : tttbench [-c sessions] [-g games] [-d seconds]
+                            [-t fifo|socket|ring] [-n size] [-k length]
+                            [-l level] [-e search|mcts] [-R games]
+                            [-s seed] [-x]
+                   Starts the given number of sessions (1 by default),
+                   each a thread with its own connection to a running
+                   tttserver, and plays for -d seconds (5 by default).
+                   Every session keeps -g games going at once (1 by
+                   default) and sends one move for each of them in a
+                   single write. Moves are random legal ones (-s sets the
+                   seed), or with -x the first empty cell, which replays
+                   the same games every run. -R reconnects after that many
+                   finished games, to measure handshakes as well. A
+                   session the server turns away (SERVER_BUSY) tries again
+                   BENCH_BUSY_MS later.
+
+                   Prints moves and games per second, the handshake rate
+                   and the percentiles of the move round trip, the time
+                   from writing a batch of moves to reading the last reply.
+
+******************************************************************************/
+
+#include <time.h>
+#include <pthread.h>
+#include "ttt.h"
+#include "tttproto.h"
+#include "tttsock.h"
+#include "tttring.h"
+#include "ttthist.h"
+
+#define TRANSPORT_FIFO	(-1)	// the public FIFO and two private FIFOs
+#define BENCH_BUSY_MS	10	// wait before asking a busy server again
+
+struct bench_conn {
+	int transport;		// TRANSPORT_FIFO, TRANSPORT_STREAM or TRANSPORT_RING
+	int rd, wr;		// the server's replies come on rd, moves go to wr
+	struct tr_end ring;
+	struct tp_reader replies;
+	char in_fifo[64], out_fifo[64];
+};
+
+struct bench_game {
+	char cell[MAX_BOARD_SIZE * MAX_BOARD_SIZE];	// 0 empty, otherwise taken
+	int empty;
+};
+
+struct bench_session {
+	pthread_t tid;
+	int id;
+	uint64_t rng;
+	long moves, games, handshakes, busy;
+	struct ttt_hist rtt;		// ns
+	struct ttt_hist hello;		// ns
+	int failed;
+};
+
+static int _sessions = 1, _games = 1, _seconds = 5, _reconnect;
+static int _transport = TRANSPORT_STREAM;
+static int _size = BOARD_SIZE, _win_len = WIN_LENGTH, _level = 9, _engine = ENGINE_SEARCH;
+static int _scripted;
+static uint64_t _seed = 1;
+static long long _deadline;
+
+static long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+//xorshift64*
+static uint64_t next_random(uint64_t* state)
+{
+	*state ^= *state >> 12;
+	*state ^= *state << 25;
+	*state ^= *state >> 27;
+	return *state * 0x2545f4914f6cdd1dULL;
+}
+
+/*****************************************************************************/
+/*                               Connection                                  */
+/*****************************************************************************/
+
+static void bench_close(struct bench_conn* c)
+{
+	if (c->transport == TRANSPORT_RING)
+		tr_close(&c->ring);
+	if (c->rd != -1)
+		close(c->rd);
+	if (c->wr != -1 && c->wr != c->rd)
+		close(c->wr);
+	if (c->transport == TRANSPORT_FIFO) {
+		unlink(c->in_fifo);
+		unlink(c->out_fifo);
+	}
+	c->rd = c->wr = -1;
+}
+
+//opens a session and reads the welcome; returns 0, SERVER_BUSY or -1
+static int bench_connect(struct bench_conn* c, int id)
+{
+	struct handshake hndshk;
+	struct tp_welcome welcome;
+	unsigned char hello[TP_MAX_FRAME];
+	const unsigned char* frame;
+	int publicfifo, len;
+
+	memset(&hndshk, 0, sizeof(hndshk));
+	hndshk.client_char = X_CELL;
+	hndshk.server_char = O_CELL;
+	hndshk.level = _level;
+	hndshk.rows = hndshk.cols = _size;
+	hndshk.win_len = _win_len;
+	hndshk.engine = _engine;
+	hndshk.transport = _transport == TRANSPORT_RING ? TRANSPORT_RING : TRANSPORT_STREAM;
+	c->transport = _transport;
+	c->rd = c->wr = -1;
+	tp_reader_init(&c->replies);
+
+	if (_transport == TRANSPORT_FIFO) {
+		sprintf(c->in_fifo, "/tmp/fifo_rd_bench_%d_%d", getpid(), id);
+		sprintf(c->out_fifo, "/tmp/fifo_wr_bench_%d_%d", getpid(), id);
+		strcpy(hndshk.client_in_fifo, c->in_fifo);
+		strcpy(hndshk.client_out_fifo, c->out_fifo);
+		unlink(c->in_fifo);
+		unlink(c->out_fifo);
+		if (mkfifo(c->in_fifo, 0666) == -1 || mkfifo(c->out_fifo, 0666) == -1 ||
+		    (c->rd = open(c->in_fifo, O_RDONLY | O_NONBLOCK)) == -1 ||
+		    (c->wr = open(c->out_fifo, O_RDWR)) == -1 ||
+		    (publicfifo = open(PUBLIC, O_WRONLY | O_NDELAY)) == -1) {
+			bench_close(c);
+			return -1;
+		}
+		len = tp_put_hello(hello, &hndshk);
+		len = write(publicfifo, hello, len) == len ? 0 : -1;
+		close(publicfifo);
+		// read only, so that a server gone is an EOF
+		if (len == -1 || tp_await(c->rd, WELCOME_MS) == -1) {
+			bench_close(c);
+			return -1;
+		}
+	}
+	else {
+		if ((c->rd = c->wr = us_connect(SOCKET_PATH)) == -1)
+			return -1;
+		if (_transport == TRANSPORT_RING)
+			len = tr_connect(c->rd, &hndshk, &c->ring);
+		else {
+			len = tp_put_hello(hello, &hndshk);
+			len = write(c->wr, hello, len) == len ? 0 : -1;
+		}
+		if (len == -1) {
+			// a busy server may have answered and hung up already
+			len = tp_read_frame(&c->replies, c->rd, &frame);
+			c->transport = TRANSPORT_STREAM;	// no ring to close
+			bench_close(c);
+			return len > 0 && tp_get_welcome(frame, len, &welcome) == 0 &&
+			       welcome.status == SERVER_BUSY ? SERVER_BUSY : -1;
+		}
+	}
+
+	if ((len = tp_read_frame(&c->replies, c->rd, &frame)) > 0 &&
+	    tp_get_welcome(frame, len, &welcome) == 0 && welcome.status == SERVER_BUSY) {
+		bench_close(c);
+		return SERVER_BUSY;
+	}
+	if (len <= 0 || tp_get_welcome(frame, len, &welcome) == -1 || welcome.status != STATUS_OK ||
+	    (_games > 1 && welcome.max_games < _games) ||
+	    (_transport == TRANSPORT_RING && welcome.transport != TRANSPORT_RING)) {
+		bench_close(c);
+		return -1;
+	}
+	return 0;
+}
+
+/*****************************************************************************/
+/*                                 Session                                   */
+/*****************************************************************************/
+
+static void new_game(struct bench_game* g)
+{
+	memset(g->cell, 0, sizeof(g->cell));
+	g->empty = _size * _size;
+}
+
+static int choose(struct bench_session* s, struct bench_game* g)
+{
+	int cell, skip;
+
+	skip = _scripted ? 0 : next_random(&s->rng) % g->empty;
+	for (cell = 0; ; cell++)
+		if (!g->cell[cell] && skip-- == 0)
+			return cell;
+}
+
+static void take(struct bench_game* g, int cell)
+{
+	if (!g->cell[cell]) {
+		g->cell[cell] = 1;
+		g->empty--;
+	}
+}
+
+//sends one move of every game and reads the replies; returns 0 or -1
+static int play_round(struct bench_session* s, struct bench_conn* c, struct bench_game* games,
+		      int* finished)
+{
+	static __thread unsigned char batch[TP_BUFFER];
+	struct move mv[TP_BUFFER / TP_GAME_MOVE_BYTES];
+	const unsigned char* frame;
+	long long start;
+	int i, id, len, used = 0;
+
+	for (i = 0; i < _games; i++) {
+		int cell = choose(s, &games[i]);
+
+		take(&games[i], cell);
+		mv[i].status = STATUS_OK;
+		mv[i].row = cell / _size;
+		mv[i].col = cell % _size;
+		if (_games > 1)
+			used += tp_put_game_move(batch + used, i, &mv[i]);
+		else if (c->transport != TRANSPORT_RING)
+			used += tp_put_move(batch + used, &mv[i]);
+	}
+
+	start = now_ns();
+	if (c->transport == TRANSPORT_RING) {
+		if (tr_push(&c->ring, &mv[0]) == -1 || !tr_wait(&c->ring, &mv[0], c->rd))
+			return -1;
+	}
+	else {
+		if (write(c->wr, batch, used) != used)
+			return -1;
+		for (i = 0; i < _games; i++) {
+			if ((len = tp_read_frame(&c->replies, c->rd, &frame)) <= 0)
+				return -1;
+			if (_games > 1) {
+				if (tp_get_game_move(frame, len, &id, &mv[i]) == -1 || id != i)
+					return -1;
+			}
+			else if (tp_get_move(frame, len, &mv[i]) == -1)
+				return -1;
+		}
+	}
+	hs_add(&s->rtt, now_ns() - start);
+	s->moves += _games;
+
+	for (i = 0; i < _games; i++) {
+		if (mv[i].status < STATUS_OK)
+			return -1;	// the server rejected a legal move
+		if (mv[i].status == STATUS_OK && games[i].empty > 0)
+			take(&games[i], mv[i].row * _size + mv[i].col);
+		if (mv[i].status != STATUS_OK) {
+			new_game(&games[i]);	// the server starts over as well
+			s->games++;
+			(*finished)++;
+		}
+	}
+	return 0;
+}
+
+static void* session_run(void* arg)
+{
+	struct bench_session* s = arg;
+	struct bench_game* games;
+	struct bench_conn c;
+	struct timespec pause = { 0, BENCH_BUSY_MS * 1000000L };
+	long long start;
+	int i, finished = 0, connected = 0, status;
+
+	if ((games = calloc(_games, sizeof(*games))) == NULL) {
+		s->failed = 1;
+		return NULL;
+	}
+	while (now_ns() < _deadline) {
+		if (!connected) {
+			start = now_ns();
+			if ((status = bench_connect(&c, s->id)) == SERVER_BUSY) {
+				s->busy++;
+				nanosleep(&pause, NULL);
+				continue;
+			}
+			if (status == -1) {
+				s->failed = 1;
+				break;
+			}
+			hs_add(&s->hello, now_ns() - start);
+			s->handshakes++;
+			connected = 1;
+			finished = 0;
+			for (i = 0; i < _games; i++)
+				new_game(&games[i]);
+		}
+		if (play_round(s, &c, games, &finished) == -1) {
+			s->failed = 1;
+			break;
+		}
+		if (_reconnect > 0 && finished >= _reconnect) {
+			bench_close(&c);
+			connected = 0;
+		}
+	}
+	if (connected)
+		bench_close(&c);
+	free(games);
+	return NULL;
+}
+
+/*****************************************************************************/
+/*                              Main Program                                 */
+/*****************************************************************************/
+
+static void usage(const char* name)
+{
+	fprintf(stderr, "usage: %s [-c sessions] [-g games] [-d seconds] [-t fifo|socket|ring]\n"
+		"       [-n size] [-k length] [-l level] [-e search|mcts] [-R games] [-s seed] [-x]\n",
+		name);
+	exit(1);
+}
+
+int main(int argc, char* argv[])
+{
+	static const char* names[] = { "fifo", "socket", "ring" };
+	struct bench_session* sessions;
+	struct ttt_hist rtt, hello;
+	long moves = 0, games = 0, handshakes = 0, busy = 0;
+	int i, opt, failed = 0;
+	double elapsed;
+	long long start;
+
+	while ((opt = getopt(argc, argv, "c:g:d:t:n:k:l:e:R:s:x")) != -1) {
+		switch (opt) {
+			case 'c': _sessions = atoi(optarg); break;
+			case 'g': _games = atoi(optarg); break;
+			case 'd': _seconds = atoi(optarg); break;
+			case 'n': _size = atoi(optarg); break;
+			case 'k': _win_len = atoi(optarg); break;
+			case 'l': _level = atoi(optarg); break;
+			case 'R': _reconnect = atoi(optarg); break;
+			case 's': _seed = strtoull(optarg, NULL, 0); break;
+			case 'x': _scripted = 1; break;
+			case 't':
+				if (strcmp(optarg, "fifo") == 0)
+					_transport = TRANSPORT_FIFO;
+				else if (strcmp(optarg, "socket") == 0)
+					_transport = TRANSPORT_STREAM;
+				else if (strcmp(optarg, "ring") == 0)
+					_transport = TRANSPORT_RING;
+				else
+					usage(argv[0]);
+				break;
+			case 'e':
+				if (strcmp(optarg, "mcts") == 0)
+					_engine = ENGINE_MCTS;
+				else if (strcmp(optarg, "search") != 0)
+					usage(argv[0]);
+				break;
+			default:
+				usage(argv[0]);
+		}
+	}
+	if (_sessions < 1 || _seconds < 1 || _games < 1 ||
+	    _games > TP_BUFFER / TP_GAME_MOVE_BYTES || (_transport == TRANSPORT_RING && _games > 1) ||
+	    _size < 1 || _size > MAX_BOARD_SIZE || _win_len < 1 || _win_len > _size) {
+		fprintf(stderr, "%s: bad settings (at most %d games per session, 1 on a ring)\n",
+			argv[0], TP_BUFFER / TP_GAME_MOVE_BYTES);
+		exit(1);
+	}
+	if ((sessions = calloc(_sessions, sizeof(*sessions))) == NULL) {
+		perror("calloc");
+		exit(1);
+	}
+	signal(SIGPIPE, SIG_IGN);
+
+	start = now_ns();
+	_deadline = start + _seconds * 1000000000LL;
+	for (i = 0; i < _sessions; i++) {
+		sessions[i].id = i;
+		sessions[i].rng = _seed * 0x9e3779b97f4a7c15ULL + i + 1;
+		if (pthread_create(&sessions[i].tid, NULL, session_run, &sessions[i]) != 0) {
+			perror("pthread_create");
+			exit(1);
+		}
+	}
+	hs_clear(&rtt);
+	hs_clear(&hello);
+	for (i = 0; i < _sessions; i++) {
+		pthread_join(sessions[i].tid, NULL);
+		moves += sessions[i].moves;
+		games += sessions[i].games;
+		handshakes += sessions[i].handshakes;
+		busy += sessions[i].busy;
+		failed += sessions[i].failed;
+		hs_merge(&rtt, &sessions[i].rtt);
+		hs_merge(&hello, &sessions[i].hello);
+	}
+	elapsed = (now_ns() - start) / 1e9;
+
+	printf("%s, %d sessions x %d games, %dx%d k=%d level %d, %.1f s\n",
+	       names[_transport + 1], _sessions, _games, _size, _size, _win_len, _level, elapsed);
+	printf("moves       %10ld  %12.0f/s\n", moves, moves / elapsed);
+	printf("games       %10ld  %12.0f/s\n", games, games / elapsed);
+	printf("handshakes  %10ld  %12.0f/s  p50 %.1f us  p99 %.1f us\n", handshakes,
+	       handshakes / elapsed, hs_percentile(&hello, 0.5) / 1e3, hs_percentile(&hello, 0.99) / 1e3);
+	printf("round trip  p50 %.1f us  p99 %.1f us  p999 %.1f us  max %.1f us\n",
+	       hs_percentile(&rtt, 0.5) / 1e3, hs_percentile(&rtt, 0.99) / 1e3,
+	       hs_percentile(&rtt, 0.999) / 1e3, rtt.max / 1e3);
+	if (busy)
+		printf("busy        %10ld  %12.0f/s\n", busy, busy / elapsed);
+	if (failed) {
+		printf("%d sessions failed\n", failed);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,104 @@
+/******************************************************************************
+  Title          : tttboard.h
+  Author         : Andriy Goltsev
+  Description    : Bitboard representation of the TTT matrix
+
+  Notes          : Every cell of the matrix is one bit, numbered in row-major
+                   order (cell = row*BOARD_SIZE + col). Each side owns one
+                   mask and the union of both masks is kept as the occupancy
+                   mask, so that the hot path (win/tie detection, legal move
+                   generation, apply/undo) is a handful of bit operations
+                   with no loops over the cells.
+
+******************************************************************************/
+
+#ifndef TTTBOARD_H
+#define TTTBOARD_H
+
+typedef unsigned int ttt_mask;
+
+#define TB_SERVER	0	// index of the server's mask
+#define TB_CLIENT	1	// index of the client's mask
+#define TB_CELLS	9
+#define TB_FULL		0x1ff	// all nine cells occupied
+#define TB_NO_CELL	-1
+
+#define TB_CELL(r, c)	((r) * 3 + (c))
+#define TB_BIT(cell)	(1u << (cell))
+#define TB_ROW(cell)	((cell) / 3)
+#define TB_COL(cell)	((cell) % 3)
+
+struct ttt_board {
+	ttt_mask side[2];	// pieces of TB_SERVER and TB_CLIENT
+	ttt_mask occupied;	// side[0] | side[1]
+};
+
+/*
+ The eight winning lines. Bit 0 is the upper left corner:
+	0 1 2
+	3 4 5
+	6 7 8
+*/
+#define TB_LINE_R0	0007
+#define TB_LINE_R1	0070
+#define TB_LINE_R2	0700
+#define TB_LINE_C0	0111
+#define TB_LINE_C1	0222
+#define TB_LINE_C2	0444
+#define TB_LINE_D0	0421
+#define TB_LINE_D1	0124
+
+static const ttt_mask tb_win_lines[8] = {
+	TB_LINE_R0, TB_LINE_R1, TB_LINE_R2,
+	TB_LINE_C0, TB_LINE_C1, TB_LINE_C2,
+	TB_LINE_D0, TB_LINE_D1
+};
+
+static inline void tb_clear(struct ttt_board* b){
+	b->side[TB_SERVER] = b->side[TB_CLIENT] = b->occupied = 0;
+}
+
+//places a piece of side on cell; the cell must be empty
+static inline void tb_apply(struct ttt_board* b, int side, int cell){
+	b->side[side] |= TB_BIT(cell);
+	b->occupied |= TB_BIT(cell);
+}
+
+//takes back a piece placed by tb_apply()
+static inline void tb_undo(struct ttt_board* b, int side, int cell){
+	b->side[side] &= ~TB_BIT(cell);
+	b->occupied &= ~TB_BIT(cell);
+}
+
+//mask of all empty cells
+static inline ttt_mask tb_legal(const struct ttt_board* b){
+	return ~b->occupied & TB_FULL;
+}
+
+static inline int tb_is_empty(const struct ttt_board* b, int cell){
+	return !(b->occupied & TB_BIT(cell));
+}
+
+static inline int tb_is_full(const struct ttt_board* b){
+	return b->occupied == TB_FULL;
+}
+
+//returns non zero if m contains a complete line; evaluated without branches
+static inline int tb_has_line(ttt_mask m){
+	return ((m & TB_LINE_R0) == TB_LINE_R0) | ((m & TB_LINE_R1) == TB_LINE_R1) |
+	       ((m & TB_LINE_R2) == TB_LINE_R2) | ((m & TB_LINE_C0) == TB_LINE_C0) |
+	       ((m & TB_LINE_C1) == TB_LINE_C1) | ((m & TB_LINE_C2) == TB_LINE_C2) |
+	       ((m & TB_LINE_D0) == TB_LINE_D0) | ((m & TB_LINE_D1) == TB_LINE_D1);
+}
+
+//number of cells set in m
+static inline int tb_count(ttt_mask m){
+	return __builtin_popcount(m);
+}
+
+//lowest cell set in m, m must not be 0
+static inline int tb_first(ttt_mask m){
+	return __builtin_ctz(m);
+}
+
+#endif
@@ -0,0 +1,102 @@
+/******************************************************************************
+  Title          : tttbook.c
+  Author         : Andriy Goltsev
+  Description    : Read-only memory-mapped perfect-play table
+
+******************************************************************************/
+
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "tttbook.h"
+#include "ttthash.h"
+
+static const unsigned char* _entries;	// mapped entry array or NULL
+static unsigned short _code[TB_FULL + 1];	// mask -> sum of 3^cell
+
+static void init_codes(void)
+{
+	int m, cell, p;
+
+	th_init();
+	for (m = 0; m <= TB_FULL; m++) {
+		_code[m] = 0;
+		for (cell = 0, p = 1; cell < TB_CELLS; cell++, p *= 3)
+			if (m & TB_BIT(cell))
+				_code[m] += p;
+	}
+}
+
+void bk_canonical(ttt_mask mine, ttt_mask theirs, struct bk_pos* pos)
+{
+	int s, index;
+
+	if (_code[TB_FULL] == 0)
+		init_codes();
+	pos->index = _code[mine] + 2 * _code[theirs];
+	pos->sym = 0;
+	for (s = 1; s < TH_SYMS; s++) {
+		index = _code[th_transform(s, mine)] + 2 * _code[th_transform(s, theirs)];
+		if (index < pos->index) {
+			pos->index = index;
+			pos->sym = s;
+		}
+	}
+}
+
+int bk_open(const char* path)
+{
+	struct bk_header* hdr;
+	struct stat st;
+	size_t len = sizeof(struct bk_header) + BK_ENTRIES;
+	void* map;
+	int fd;
+
+	if ((fd = open(path, O_RDONLY)) == -1)
+		return -1;
+	if (fstat(fd, &st) == -1 || st.st_size != (off_t) len) {
+		close(fd);
+		errno = EINVAL;
+		return -1;
+	}
+	map = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd); // the mapping stays valid
+	if (map == MAP_FAILED)
+		return -1;
+
+	hdr = (struct bk_header*) map;
+	if (memcmp(hdr->magic, BK_MAGIC, 4) != 0 || hdr->version != BK_VERSION ||
+	    hdr->entries != BK_ENTRIES) {
+		munmap(map, len);
+		errno = EINVAL;
+		return -1;
+	}
+	if (_code[TB_FULL] == 0)
+		init_codes();
+	_entries = (const unsigned char*) map + sizeof(struct bk_header);
+	return 0;
+}
+
+int bk_loaded(void)
+{
+	return _entries != NULL;
+}
+
+int bk_best_move(const struct ttt_board* b, int side, int* outcome)
+{
+	struct bk_pos pos;
+	unsigned char e;
+
+	if (_entries == NULL || tb_is_full(b))
+		return TB_NO_CELL;
+	bk_canonical(b->side[side], b->side[!side], &pos);
+	e = _entries[pos.index];
+	if (BK_OUTCOME(e) == BK_UNKNOWN)
+		return TB_NO_CELL;
+	*outcome = BK_OUTCOME(e);
+	return th_from_canonical(pos.sym, BK_MOVE(e));
+}
@@ -0,0 +1,67 @@
+/******************************************************************************
+  Title          : tttbook.h
+  Author         : Andriy Goltsev
+  Description    : Precomputed perfect-play table ("book") for the server
+
+  Notes          : The book is written once by tttgen and memory-mapped
+                   read-only by tttserver at startup, so all forked children
+                   share the same physical pages and answer with one lookup.
+
+                   File layout (all integers little-endian):
+                       struct bk_header
+                       unsigned char entry[BK_ENTRIES]
+                   An entry is indexed by the base-3 code of the canonical
+                   position (0 empty, 1 side to move, 2 opponent per cell,
+                   cell 0 the least significant digit). The canonical
+                   position is the symmetry with the smallest code. The low
+                   nibble is the best move in canonical cells, bits 4-5 are
+                   the outcome for the side to move. Unreachable positions
+                   are 0 (BK_UNKNOWN).
+
+******************************************************************************/
+
+#ifndef TTTBOOK_H
+#define TTTBOOK_H
+
+#include <stdint.h>
+#include "tttboard.h"
+
+#define BK_MAGIC	"TTTB"
+#define BK_VERSION	1
+#define BK_ENTRIES	19683	// 3^9
+#define BK_DEFAULT	"ttt.book"
+
+#define BK_UNKNOWN	0
+#define BK_WIN		1
+#define BK_DRAW		2
+#define BK_LOSS		3
+
+#define BK_ENTRY(move, outcome)	((unsigned char) (((outcome) << 4) | (move)))
+#define BK_MOVE(entry)		((entry) & 0x0f)
+#define BK_OUTCOME(entry)	(((entry) >> 4) & 0x03)
+
+struct bk_header {
+	char magic[4];
+	uint32_t version;
+	uint32_t entries;
+	uint32_t reserved;
+};
+
+struct bk_pos {
+	int index;	// base-3 code of the canonical position
+	int sym;	// symmetry that maps the board onto it (see ttthash.h)
+};
+
+//computes the canonical index of mine/theirs with mine to move
+void bk_canonical(ttt_mask mine, ttt_mask theirs, struct bk_pos* pos);
+
+//maps the book at path; returns 0 or -1 with errno set
+int bk_open(const char* path);
+
+//returns non zero once a book is mapped
+int bk_loaded(void);
+
+//returns the book's move for side on b and sets *outcome, or TB_NO_CELL
+int bk_best_move(const struct ttt_board* b, int side, int* outcome);
+
+#endif
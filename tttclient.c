@@ -11,7 +11,15 @@
   Usage          : Starts tik-tak-toe game with the server. The server must be running
 		   in order to use this client. 	
   
-  Running	 : tttclient
+  Running	 : tttclient [-l level] [-n size] [-k length] [-e engine]
+		   -l sets the server's strength: 0 takes the first empty
+		      cell, 1-9 is the number of plies it looks ahead (9,
+		      the default, is perfect play)
+		   -n plays on a size x size board (3 by default, at most
+		      MAX_BOARD_SIZE) and -k sets how many pieces in a row
+		      win (3 by default)
+		   -e picks the server's engine: "search" (alpha-beta, the
+		      default) or "mcts" (Monte Carlo tree search)
 
   Notes 	 : Client does not check if the server is actually running. 
 		   It only checks if the public pipe is present.                 
@@ -24,6 +32,9 @@
                          // header file shared by sender and receiver, 
 
 #include<curses.h>
+#include "tttsearch.h"
+#include "tttsock.h"
+#include "tttproto.h"
 
 /*****************************************************************************/
 /*                           Defined Constants                               */
@@ -47,12 +58,14 @@ const char  _visual_board[VISUAL_BOARD_SIZE][VISUAL_BOARD_SIZE+1] = {
 "  |   |  ", 
 "         "};
 
-ttt_type _board[BOARD_SIZE][BOARD_SIZE]; // TTT matrix
+ttt_type _board[MAX_BOARD_SIZE][MAX_BOARD_SIZE]; // TTT matrix
+int _size = BOARD_SIZE; //the board is _size x _size
+int _win_len = WIN_LENGTH; //pieces in a row needed to win
 int row_pos, col_pos; //position of the upper left corner of TTT grid
 int  _clientChar = X_CELL; //char for me 'X'
 int  _serverChar = O_CELL; //char for server 'o'
 int _max_row, _max_col; // lowest row/col
-int _visual_step = VISUAL_BOARD_SIZE/BOARD_SIZE; //step is used to draw TTT matrix 
+int _visual_step = VISUAL_BOARD_SIZE/BOARD_SIZE; //step is used to draw TTT matrix, 1 for large boards
 int _game_over_flag; //indicate if the game is over
 
 int            in_fifo_fd; // file descriptor for READ PRIVATE FIFO
@@ -76,8 +89,14 @@ void init_curses(){
 	getmaxyx(stdscr,_max_row,_max_col);
 	
 
-	row_pos = _max_row/2 - VISUAL_BOARD_SIZE/2;
-	col_pos = _max_col/2 - VISUAL_BOARD_SIZE/2;
+	if(_size == BOARD_SIZE){
+		row_pos = _max_row/2 - VISUAL_BOARD_SIZE/2;
+		col_pos = _max_col/2 - VISUAL_BOARD_SIZE/2;
+	} else { //larger boards are drawn one line per row, without the grid
+		_visual_step = 1;
+		row_pos = _max_row/2 - _size/2;
+		col_pos = _max_col/2 - _size;
+	}
 	
 	refresh();
 }
@@ -106,8 +125,8 @@ void printCharAt(int r, int c, int ch);
 // clear the board
 void clear_board(){
 	int i,j;	
-	for(i = 0; i < BOARD_SIZE; i++)
-		for(j = 0; j < BOARD_SIZE; j++)
+	for(i = 0; i < _size; i++)
+		for(j = 0; j < _size; j++)
 			_board[i][j] = EMPTY_CELL;
 }
 
@@ -154,8 +173,52 @@ int main( int argc, char *argv[])
     struct sigaction handler;
 
     struct move clients_move, servers_move;
+    static struct tp_reader replies; // frames from the server
+    struct tp_welcome welcome;       // the server's answer to the hello
+    unsigned char    frame[TP_MAX_FRAME];
+    const unsigned char* in;
+    int              opt;
+    int              level = TS_LEVEL_PERFECT;
+    int              engine = ENGINE_SEARCH;
+    int              use_socket = 0; // connect to SOCKET_PATH instead of PUBLIC
     _game_over_flag = 0;
 
+    while ( (opt = getopt(argc, argv, "l:n:k:e:u")) != -1 ) {
+        switch (opt) {
+            case 'l':
+                level = atoi(optarg);
+                break;
+            case 'n':
+                _size = atoi(optarg);
+                break;
+            case 'k':
+                _win_len = atoi(optarg);
+                break;
+            case 'e':
+                if ( strcmp(optarg, "mcts") == 0 )
+                    engine = ENGINE_MCTS;
+                else if ( strcmp(optarg, "search") == 0 )
+                    engine = ENGINE_SEARCH;
+                else {
+                    fprintf(stderr, "unknown engine %s\n", optarg);
+                    exit(1);
+                }
+                break;
+            case 'u':
+                use_socket = 1;
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-l level] [-n size] [-k length] [-e engine] [-u]\n",
+                        argv[0]);
+                exit(1);
+        }
+    }
+    if ( _size < 1 || _size > MAX_BOARD_SIZE || _win_len < 1 || _win_len > _size ) {
+        fprintf(stderr, "board size must be 1-%d and the winning length 1-size\n",
+                MAX_BOARD_SIZE);
+        exit(1);
+    }
+
     
 
     publicfifo = -1;
@@ -181,40 +244,90 @@ int main( int argc, char *argv[])
         exit(1);
     }
 
-    // Create unique names for private FIFOs using process-id
-    sprintf(_handshk.client_in_fifo, "/tmp/fifo_rd_%s_%d", MY_NAME,getpid());
-    sprintf(_handshk.client_out_fifo, "/tmp/fifo_wr_%s_%d",MY_NAME,getpid());
     _handshk.client_char = _clientChar;
     _handshk.server_char = _serverChar;
-
-    // Create the private FIFOs
-    if ( mkfifo(_handshk.client_in_fifo, 0666) < 0 ) {
-        perror(_handshk.client_in_fifo);
-        exit(1);
+    _handshk.level = level;
+    _handshk.rows = _size;
+    _handshk.cols = _size;
+    _handshk.win_len = _win_len;
+    _handshk.engine = engine;
+
+    if ( use_socket ) {
+        // One connection carries the handshake and the whole game; no
+        // private FIFOs are created
+        if ( (publicfifo = us_connect(SOCKET_PATH)) == -1 ) {
+            if ( errno == ENOENT || errno == ECONNREFUSED )
+                fprintf(stderr,"%s", startup_msg);
+            else
+                perror(SOCKET_PATH);
+            exit(1);
+        }
+        write(publicfifo, frame, tp_put_hello(frame, &_handshk));
+        in_fifo_fd = out_fifo_fd = publicfifo;
     }
-
-    if ( mkfifo(_handshk.client_out_fifo, 0666) < 0 ) {
-        perror(_handshk.client_out_fifo);
-        exit(1);
+    else {
+        // Create unique names for private FIFOs using process-id
+        sprintf(_handshk.client_in_fifo, "/tmp/fifo_rd_%s_%d", MY_NAME,getpid());
+        sprintf(_handshk.client_out_fifo, "/tmp/fifo_wr_%s_%d",MY_NAME,getpid());
+
+        // Create the private FIFOs
+        if ( mkfifo(_handshk.client_in_fifo, 0666) < 0 ) {
+            perror(_handshk.client_in_fifo);
+            exit(1);
+        }
+
+        if ( mkfifo(_handshk.client_out_fifo, 0666) < 0 ) {
+            perror(_handshk.client_out_fifo);
+            exit(1);
+        }
+
+        // Open the public FIFO for writing
+        if ( (publicfifo = open(PUBLIC, O_WRONLY | O_NDELAY) ) == -1) {
+            if ( errno == ENXIO ) 
+                fprintf(stderr,"%s", startup_msg);
+            else 
+                perror(PUBLIC);
+            exit(1);
+        }
+
+        // Open the write fifo for reading and writing
+        if ((out_fifo_fd = open(_handshk.client_out_fifo, O_RDWR) ) == -1 ) {
+            perror(_handshk.client_out_fifo);
+            exit(1);
+        }
+
+        // The read fifo stays open for the whole session as well, so the
+        // server can open its write end once and keep writing replies to it.
+        // Read only, so that the server going away is an EOF; without
+        // blocking until the server opens it
+        if ((in_fifo_fd = open(_handshk.client_in_fifo, O_RDONLY | O_NONBLOCK) ) == -1 ) {
+            perror(_handshk.client_in_fifo);
+            exit(1);
+        }
+    
+        // Send a message to server with names of two FIFOs
+        write(publicfifo, frame, tp_put_hello(frame, &_handshk));
+        if ( tp_await(in_fifo_fd, WELCOME_MS) == -1 ) {
+            fprintf(stderr, "the server did not answer the handshake\n");
+            on_signal(SIGTERM);
+        }
     }
 
-    // Open the public FIFO for writing
-    if ( (publicfifo = open(PUBLIC, O_WRONLY | O_NDELAY) ) == -1) {
-        if ( errno == ENXIO ) 
-            fprintf(stderr,"%s", startup_msg);
-        else 
-            perror(PUBLIC);
-        exit(1);
+    // The server answers the hello before the first move
+    if ( (bytesRead = tp_read_frame(&replies, in_fifo_fd, &in)) <= 0 ||
+         tp_get_welcome(in, bytesRead, &welcome) == -1 ) {
+        fprintf(stderr, "the server did not answer the handshake\n");
+        on_signal(SIGTERM);
     }
-
-    // Open the write fifo for reading and writing
-    if ((out_fifo_fd = open(_handshk.client_out_fifo, O_RDWR) ) == -1 ) {
-        perror(_handshk.client_out_fifo);
-        exit(1);
+    if ( welcome.status == SERVER_BUSY ) {
+        fprintf(stderr, "the server is busy, try again later\n");
+        on_signal(SIGTERM);
+    }
+    if ( welcome.status == INVALID_BOARD ) {
+        fprintf(stderr, "the server cannot play %dx%d with %d in a row (boards up to %dx%d)\n",
+                _size, _size, _win_len, welcome.max_side, welcome.max_side);
+        on_signal(SIGTERM);
     }
-    
-    // Send a message to server with names of two FIFOs
-    write(publicfifo, (char*) &_handshk, sizeof(_handshk));
 
     //start game 
 
@@ -225,27 +338,22 @@ int main( int argc, char *argv[])
     // Get one line of input at a time from the input source
     while (1) {
 	    userTurn(&clients_move); 
-            write(out_fifo_fd, (char*) &clients_move, sizeof(clients_move));
-              
-	        // Open the private FIFO for reading to get output of command
-	        // from the server.
-	        if ((in_fifo_fd = open(_handshk.client_in_fifo, O_RDONLY) ) == -1) {
-	            perror(_handshk.client_in_fifo);
-	            exit(1);
+            write(out_fifo_fd, frame, tp_put_move(frame, &clients_move));
+
+	        // Every reply is one move frame, written atomically by the
+	        // server on the open private FIFO
+	        bytesRead = tp_read_frame(&replies, in_fifo_fd, &in);
+	        if ( bytesRead <= 0 || tp_get_move(in, bytesRead, &servers_move) == -1 ) {
+	            endwin();
+	            fprintf(stderr, "lost the server\n");
+	            break;
 	        }
-
-	        // Read maximum number of bytes possible atomically
-	        // and copy them to standard output.
-            	while ((bytesRead= read(in_fifo_fd, (struct move*) &servers_move, sizeof(servers_move))) > 0)
-	            processServerResponse(&servers_move, &clients_move); 
-	        
-            close(in_fifo_fd);      
-            in_fifo_fd   = -1;
-        
+	        processServerResponse(&servers_move, &clients_move); 
     }
     // User quit, so close write-end of public FIFO and delete private FIFO
     close(publicfifo);
     close(out_fifo_fd);
+    close(in_fifo_fd);
     unlink(_handshk.client_in_fifo);
     unlink(_handshk.client_out_fifo);
     endwin();                       /* End curses mode*/
@@ -278,16 +386,16 @@ void userTurn(struct move* mv){
 	while((ch = getch()) != ' '){
 		switch(ch){
 			case(KEY_DOWN):
-				if (++row >= BOARD_SIZE) row = 0; 
+				if (++row >= _size) row = 0; 
 				break;
 			case(KEY_UP):
-				if(--row < 0) row = BOARD_SIZE - 1;
+				if(--row < 0) row = _size - 1;
 				break;
 			case(KEY_RIGHT):
-				if(++col >= BOARD_SIZE ) col = 0;
+				if(++col >= _size ) col = 0;
 				break;
 			case(KEY_LEFT):
-				if(--col < 0) col = BOARD_SIZE - 1;
+				if(--col < 0) col = _size - 1;
 				break;
 			case('q') : 
 				on_signal(0);
@@ -315,6 +423,12 @@ void processServerResponse(const struct move* mv, const struct move* my_mv){
 		case(INVALID_MOVE):
 			mvprintw(_max_row-1, 1, "Ivalid move");
 			break;   
+		case(INVALID_BOARD):
+			endwin();
+			fprintf(stderr, "The server cannot play on a %dx%d board.\n", _size, _size);
+			unlink(_handshk.client_in_fifo);
+			unlink(_handshk.client_out_fifo);
+			exit(1);
 		case(CLIENT_WINS):
 			_game_over_flag = 1;
 			_board[mv->row][mv->col] = _serverChar;
@@ -346,6 +460,7 @@ void moveCursorTo(int r, int c){
 }
 
 void printCharAt(int r, int c, int ch){
+	if(ch == EMPTY_CELL && _visual_step == 1) ch = '.'; //no grid lines on large boards
 	mvprintw((row_pos + r*_visual_step), (col_pos + c*(1 + _visual_step)), "%c", ch);
 	refresh();
 }
@@ -353,8 +468,8 @@ void printCharAt(int r, int c, int ch){
 void drawBoard(){
 	int i;
 	int j ;
-	for(i = 0; i < BOARD_SIZE; i++){
-		for(j = 0; j < BOARD_SIZE;j++){
+	for(i = 0; i < _size; i++){
+		for(j = 0; j < _size;j++){
 			printCharAt( i, j, _board[i][j]);	
 		}
 	}
@@ -367,6 +482,13 @@ void drawGame(){
 	mvprintw(3, 1, "and space key2 to make a move. You are x's and I am o's." );
 	mvprintw(4, 10, "Press q anytime to quit. Good luck!!!!!" );
 
+	if(_win_len != WIN_LENGTH || _size != BOARD_SIZE)
+		mvprintw(5, 10, "%dx%d board, %d in a row wins.", _size, _size, _win_len);
+
+	if(_size != BOARD_SIZE){
+		drawBoard();
+		return;
+	}
 	for(;i<VISUAL_BOARD_SIZE;i++)
 		mvprintw(row_pos+i, col_pos, "%s", _visual_board[i]);
 }
@@ -0,0 +1,502 @@
+/******************************************************************************
+  Title          : tttdeep.c
+  Author         : Andriy Goltsev
+  Description    : Iterative deepening alpha-beta with a hard deadline
+
+  Notes          : Moves are ordered as: a win, a block of the opponent's
+                   win, the transposition table's move (the previous
+                   iteration's best move at the root), the two killer moves
+                   of the ply, then by the history table. Killers and history
+                   survive between iterations, which is what makes
+                   re-searching the shallow plies cheap.
+
+                   The clock is read every TD_CHECK nodes. Once the deadline
+                   passes the iteration in progress is thrown away.
+
+                   Parallel search: every iteration is a job whose root moves
+                   are handed out one at a time from an atomic counter, so a
+                   thread that finishes a cheap subtree takes the next move
+                   instead of waiting for the others. The searching threads
+                   are the caller plus a pool of workers started on the
+                   first parallel search of the process; each keeps its own
+                   killers and history. All threads share one transposition
+                   table without locks: an entry is stored as (key ^ data,
+                   data), so a torn write fails the key check and reads as
+                   a miss. The table lives as long as the process, which
+                   may play boards of any geometry, so the key of a
+                   position includes a key of rows, cols and k: the same
+                   pieces on 8x8 with k = 4 and with k = 5 are different
+                   positions.
+
+******************************************************************************/
+
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "tttdeep.h"
+#include "tttsearch.h"
+
+#define TD_WIN		1000000000
+#define TD_INF		(TD_WIN + 1)
+#define TD_CHECK	256
+#define TD_MATE		(TD_WIN - TD_MAX_PLY)	// scores above are forced wins
+
+#define TD_SCORE_WIN	(1 << 30)
+#define TD_SCORE_BLOCK	(1 << 29)
+#define TD_SCORE_HINT	(1 << 28)
+#define TD_SCORE_KILLER	(1 << 27)
+
+#define TD_TT_SIZE	(1 << 16)	// entries, a power of two
+#define TD_EXACT	1
+#define TD_LOWER	2
+#define TD_UPPER	3
+
+struct td_search {
+	struct ttt_grid g;
+	uint64_t key;				// Zobrist key of g
+	long long deadline;			// ns, CLOCK_MONOTONIC
+	long nodes;
+	int aborted;
+	unsigned move_id;			// td_best_move() call the tables belong to
+	int killers[TD_MAX_PLY][2];
+	int history[2][TG_MAX_CELLS];
+};
+
+struct td_entry {
+	_Atomic uint64_t check;			// key ^ data
+	_Atomic uint64_t data;
+};
+
+// one iteration of the root, shared by every searching thread
+struct td_job {
+	struct ttt_grid g;
+	uint64_t key;
+	int side, depth;
+	long long deadline;
+	unsigned move_id;
+	int n;
+	int moves[TG_MAX_CELLS];
+	atomic_int next;			// next root move to hand out
+	atomic_int alpha;			// best score of the iteration so far
+	atomic_int aborted;
+	int best;				// cell that scored alpha
+	pthread_mutex_t lock;			// guards best
+};
+
+// value of an open window holding n pieces of one side
+static const int _weight[TG_MAX_SIDE + 1] = {
+	0, 1, 4, 16, 64, 256, 1024, 4096, 16384, 65536,
+	65536, 65536, 65536, 65536, 65536, 65536, 65536
+};
+
+static uint64_t _zobrist[2][TG_MAX_CELLS];
+static uint64_t _zobrist_side;
+static struct td_entry _tt[TD_TT_SIZE];
+static int _threads = 1;
+static unsigned _move_id;
+
+// worker pool, started by the first parallel search of the process
+static pthread_mutex_t _pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t _pool_wake = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t _pool_idle = PTHREAD_COND_INITIALIZER;
+static struct td_job* _pool_job;
+static unsigned _pool_generation;
+static int _pool_busy;
+static int _workers;
+
+static long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+//splitmix64, as in ttthash.c
+static uint64_t next_key(uint64_t* state)
+{
+	uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+static void init_keys(void)
+{
+	uint64_t state = 0x4444444444444444ULL;
+	int side, cell;
+
+	for (side = 0; side < 2; side++)
+		for (cell = 0; cell < TG_MAX_CELLS; cell++)
+			_zobrist[side][cell] = next_key(&state);
+	_zobrist_side = next_key(&state);
+}
+
+static uint64_t grid_key(const struct ttt_grid* g, int side)
+{
+	uint64_t state = (uint64_t) g->rows << 16 | g->cols << 8 | g->k;
+	uint64_t key = next_key(&state) ^ (side ? _zobrist_side : 0);
+	int cell;
+
+	for (cell = 0; cell < g->cells; cell++) {
+		if (tg_test(&g->side[TB_SERVER], cell))
+			key ^= _zobrist[TB_SERVER][cell];
+		else if (tg_test(&g->side[TB_CLIENT], cell))
+			key ^= _zobrist[TB_CLIENT][cell];
+	}
+	return key;
+}
+
+static void apply(struct td_search* s, int side, int cell)
+{
+	tg_apply(&s->g, side, cell);
+	s->key ^= _zobrist[side][cell] ^ _zobrist_side;
+}
+
+static void undo(struct td_search* s, int side, int cell)
+{
+	tg_undo(&s->g, side, cell);
+	s->key ^= _zobrist[side][cell] ^ _zobrist_side;
+}
+
+static void reset_tables(struct td_search* s, unsigned move_id)
+{
+	int i;
+
+	s->move_id = move_id;
+	for (i = 0; i < TD_MAX_PLY; i++)
+		s->killers[i][0] = s->killers[i][1] = TB_NO_CELL;
+	for (i = 0; i < TG_MAX_CELLS; i++)
+		s->history[0][i] = s->history[1][i] = 0;
+}
+
+/*****************************************************************************/
+/*                         Transposition table                               */
+/*****************************************************************************/
+
+// forced win scores are stored relative to the node, not to the root
+static int to_tt(int score, int ply)
+{
+	return score > TD_MATE ? score + ply : score < -TD_MATE ? score - ply : score;
+}
+
+static int from_tt(int score, int ply)
+{
+	return score > TD_MATE ? score - ply : score < -TD_MATE ? score + ply : score;
+}
+
+static void tt_store(uint64_t key, int score, int depth, int flag, int move)
+{
+	struct td_entry* e = &_tt[key & (TD_TT_SIZE - 1)];
+	uint64_t data = (uint32_t) score | (uint64_t) depth << 32 |
+			(uint64_t) flag << 40 | (uint64_t) (move + 1) << 42;
+
+	atomic_store_explicit(&e->check, key ^ data, memory_order_relaxed);
+	atomic_store_explicit(&e->data, data, memory_order_relaxed);
+}
+
+//returns 0 on a miss, otherwise fills in the entry's fields
+static int tt_probe(uint64_t key, int* score, int* depth, int* flag, int* move)
+{
+	struct td_entry* e = &_tt[key & (TD_TT_SIZE - 1)];
+	uint64_t data = atomic_load_explicit(&e->data, memory_order_relaxed);
+
+	if (data == 0 || (atomic_load_explicit(&e->check, memory_order_relaxed) ^ data) != key)
+		return 0;
+	*score = (int32_t) (uint32_t) data;
+	*depth = (data >> 32) & 0xff;
+	*flag = (data >> 40) & 0x3;
+	*move = (int) ((data >> 42) & 0x1ff) - 1;
+	return 1;
+}
+
+/*****************************************************************************/
+/*                                Search                                     */
+/*****************************************************************************/
+
+//sum of the open windows of side minus those of the opponent
+static int evaluate(const struct ttt_grid* g, int side)
+{
+	static const int dr[4] = { 0, 1, 1, 1 };
+	static const int dc[4] = { 1, 0, 1, -1 };
+	int d, r, c, i, cell, mine, theirs, score = 0;
+
+	for (d = 0; d < 4; d++) {
+		for (r = 0; r < g->rows; r++) {
+			for (c = 0; c < g->cols; c++) {
+				if (r + (g->k - 1) * dr[d] >= g->rows ||
+				    c + (g->k - 1) * dc[d] < 0 || c + (g->k - 1) * dc[d] >= g->cols)
+					continue;
+				mine = theirs = 0;
+				for (i = 0; i < g->k; i++) {
+					cell = tg_cell(g, r + i * dr[d], c + i * dc[d]);
+					mine += tg_test(&g->side[side], cell);
+					theirs += tg_test(&g->side[!side], cell);
+				}
+				if (theirs == 0)
+					score += _weight[mine];
+				else if (mine == 0)
+					score -= _weight[theirs];
+			}
+		}
+	}
+	return score;
+}
+
+//fills moves[] with the candidate cells in search order, returns their count
+static int order_moves(struct td_search* s, int side, int ply, int hint, int* moves)
+{
+	int keys[TG_MAX_CELLS];
+	tg_bits frontier;
+	uint64_t free;
+	int w, cell, key, i, n = 0;
+
+	tg_frontier(&s->g, &frontier);
+	for (w = 0; w < TG_WORDS; w++) {
+		for (free = frontier.w[w]; free; free &= free - 1) {
+			cell = (w << 6) + __builtin_ctzll(free);
+			if (tg_makes_line(&s->g, side, cell))
+				key = TD_SCORE_WIN;
+			else if (tg_makes_line(&s->g, !side, cell))
+				key = TD_SCORE_BLOCK;
+			else if (cell == hint)
+				key = TD_SCORE_HINT;
+			else if (cell == s->killers[ply][0] || cell == s->killers[ply][1])
+				key = TD_SCORE_KILLER;
+			else
+				key = s->history[side][cell];
+			// insertion sort, best key first
+			for (i = n++; i > 0 && keys[i - 1] < key; i--) {
+				keys[i] = keys[i - 1];
+				moves[i] = moves[i - 1];
+			}
+			keys[i] = key;
+			moves[i] = cell;
+		}
+	}
+	return n;
+}
+
+static void remember_cutoff(struct td_search* s, int side, int ply, int cell, int depth)
+{
+	if (s->killers[ply][0] != cell) {
+		s->killers[ply][1] = s->killers[ply][0];
+		s->killers[ply][0] = cell;
+	}
+	if ((s->history[side][cell] += depth * depth) >= TD_SCORE_KILLER)
+		for (cell = 0; cell < TG_MAX_CELLS; cell++)
+			s->history[side][cell] /= 2;
+}
+
+static int search(struct td_search* s, int side, int depth, int ply, int alpha, int beta)
+{
+	int moves[TG_MAX_CELLS];
+	int i, n, score, best = -TD_INF, best_move = TB_NO_CELL, alpha0 = alpha;
+	int tt_score, tt_depth, tt_flag, hint = TB_NO_CELL;
+
+	if ((++s->nodes % TD_CHECK) == 0 && now_ns() >= s->deadline)
+		s->aborted = 1;
+	if (s->aborted)
+		return 0;
+	if (depth == 0 || ply >= TD_MAX_PLY)
+		return evaluate(&s->g, side);
+
+	if (tt_probe(s->key, &tt_score, &tt_depth, &tt_flag, &hint) && tt_depth >= depth) {
+		tt_score = from_tt(tt_score, ply);
+		if (tt_flag == TD_EXACT)
+			return tt_score;
+		if (tt_flag == TD_LOWER && tt_score > alpha)
+			alpha = tt_score;
+		else if (tt_flag == TD_UPPER && tt_score < beta)
+			beta = tt_score;
+		if (alpha >= beta)
+			return tt_score;
+	}
+
+	if ((n = order_moves(s, side, ply, hint, moves)) == 0)
+		return evaluate(&s->g, side);	// every empty cell is far from the play
+	for (i = 0; i < n; i++) {
+		apply(s, side, moves[i]);
+		if (s->g.winner == side)
+			score = TD_WIN - ply;
+		else if (tg_is_full(&s->g))
+			score = 0;
+		else
+			score = -search(s, !side, depth - 1, ply + 1, -beta, -alpha);
+		undo(s, side, moves[i]);
+		if (s->aborted)
+			return 0;
+		if (score > best) {
+			best = score;
+			best_move = moves[i];
+			if (best > alpha)
+				alpha = best;
+			if (alpha >= beta) {
+				remember_cutoff(s, side, ply, moves[i], depth);
+				break;
+			}
+		}
+	}
+
+	tt_store(s->key, to_tt(best, ply), depth,
+		 best <= alpha0 ? TD_UPPER : best >= beta ? TD_LOWER : TD_EXACT, best_move);
+	return best;
+}
+
+/*****************************************************************************/
+/*                             Parallel root                                 */
+/*****************************************************************************/
+
+//searches root moves of job until none are left; run by every thread
+static void run_job(struct td_job* job, struct td_search* s)
+{
+	int i, cell, score, alpha;
+
+	if (s->move_id != job->move_id)
+		reset_tables(s, job->move_id);
+	s->g = job->g;
+	s->key = job->key;
+	s->deadline = job->deadline;
+	s->aborted = 0;
+
+	while ((i = atomic_fetch_add(&job->next, 1)) < job->n) {
+		cell = job->moves[i];
+		alpha = atomic_load(&job->alpha);
+		apply(s, job->side, cell);
+		if (s->g.winner == job->side)
+			score = TD_WIN;
+		else if (tg_is_full(&s->g))
+			score = 0;
+		else
+			score = -search(s, !job->side, job->depth - 1, 1, -TD_INF, -alpha);
+		undo(s, job->side, cell);
+		if (s->aborted) {
+			atomic_store(&job->aborted, 1);
+			return;
+		}
+		pthread_mutex_lock(&job->lock);
+		if (score > atomic_load(&job->alpha)) {
+			atomic_store(&job->alpha, score);
+			job->best = cell;
+		}
+		pthread_mutex_unlock(&job->lock);
+	}
+}
+
+static void* worker(void* arg)
+{
+	struct td_search s;
+	struct td_job* job;
+	unsigned seen = 0;
+
+	s.move_id = 0;
+	pthread_mutex_lock(&_pool_lock);
+	for (;;) {
+		while (_pool_generation == seen)
+			pthread_cond_wait(&_pool_wake, &_pool_lock);
+		seen = _pool_generation;
+		job = _pool_job;
+		pthread_mutex_unlock(&_pool_lock);
+
+		run_job(job, &s);
+
+		pthread_mutex_lock(&_pool_lock);
+		if (--_pool_busy == 0)
+			pthread_cond_signal(&_pool_idle);
+	}
+	return NULL;
+}
+
+//starts workers until there are _threads - 1 of them
+static void start_workers(void)
+{
+	pthread_t tid;
+	pthread_attr_t attr;
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	pthread_attr_setstacksize(&attr, 4 << 20);	// deep recursion, big frames
+	while (_workers < _threads - 1 && pthread_create(&tid, &attr, worker, NULL) == 0)
+		_workers++;
+	pthread_attr_destroy(&attr);
+}
+
+//runs job on the calling thread and every worker, returns once all are done
+static void run_parallel(struct td_job* job, struct td_search* s)
+{
+	if (_workers > 0) {
+		pthread_mutex_lock(&_pool_lock);
+		_pool_job = job;
+		_pool_busy = _workers;
+		_pool_generation++;
+		pthread_cond_broadcast(&_pool_wake);
+		pthread_mutex_unlock(&_pool_lock);
+	}
+
+	run_job(job, s);
+
+	if (_workers > 0) {
+		pthread_mutex_lock(&_pool_lock);
+		while (_pool_busy > 0)
+			pthread_cond_wait(&_pool_idle, &_pool_lock);
+		pthread_mutex_unlock(&_pool_lock);
+	}
+}
+
+void td_set_threads(int threads)
+{
+	_threads = threads < 1 ? 1 : threads > TD_MAX_THREADS ? TD_MAX_THREADS : threads;
+}
+
+int td_best_move(const struct ttt_grid* g, int side, int level, long budget_ms)
+{
+	static struct td_job job;
+	struct td_search s;
+	int depth, max_depth, best;
+
+	// the quick answer stands if not even one iteration completes
+	best = ts_grid_move(g, side, level);
+	if (best == TB_NO_CELL || level <= 0 || g->moves == 0 ||
+	    tg_makes_line(g, side, best))
+		return best;
+
+	if (_zobrist_side == 0) {
+		init_keys();
+		pthread_mutex_init(&job.lock, NULL);
+	}
+	if (_workers < _threads - 1)
+		start_workers();
+
+	job.g = *g;
+	job.key = grid_key(g, side);
+	job.side = side;
+	job.deadline = now_ns() + budget_ms * 1000000LL;
+	job.move_id = ++_move_id;
+	reset_tables(&s, job.move_id);
+	s.g = *g;
+
+	max_depth = g->cells - g->moves;
+	if (max_depth > level)
+		max_depth = level;
+	if (max_depth > TD_MAX_PLY)
+		max_depth = TD_MAX_PLY;
+
+	for (depth = 1; depth <= max_depth; depth++) {
+		if ((job.n = order_moves(&s, side, 0, best, job.moves)) == 0)
+			break;
+		job.depth = depth;
+		job.best = job.moves[0];
+		atomic_store(&job.next, 0);
+		atomic_store(&job.alpha, -TD_INF);
+		atomic_store(&job.aborted, 0);
+
+		run_parallel(&job, &s);
+
+		if (atomic_load(&job.aborted))
+			break;
+		best = job.best;
+		if (atomic_load(&job.alpha) > TD_MATE || atomic_load(&job.alpha) < -TD_MATE)
+			break;	// the outcome is decided, deeper searches change nothing
+	}
+	return best;
+}
@@ -0,0 +1,36 @@
+/******************************************************************************
+  Title          : tttdeep.h
+  Author         : Andriy Goltsev
+  Description    : Time bounded search for boards larger than 3x3
+
+  Notes          : A full search is out of reach on k-in-a-row boards, so
+                   the server deepens an alpha-beta search one ply at a time
+                   until the strength level or the per-move time budget runs
+                   out, and answers with the best move of the last completed
+                   iteration. Only empty cells next to a piece are searched;
+                   leaves are scored by the open k-windows of each side.
+
+                   With td_set_threads() above 1 every iteration is searched
+                   by that many threads of the calling process, which share
+                   one transposition table. The count is the budget of one
+                   game, so a deep search cannot take every core.
+
+******************************************************************************/
+
+#ifndef TTTDEEP_H
+#define TTTDEEP_H
+
+#include "tttgrid.h"
+
+#define TD_BUDGET_MS	200	// default time budget per server move
+#define TD_MAX_PLY	64
+#define TD_MAX_THREADS	64
+
+//returns the cell side should play on g within budget_ms milliseconds, or
+//TB_NO_CELL if the board is full; level caps the depth in plies
+int td_best_move(const struct ttt_grid* g, int side, int level, long budget_ms);
+
+//sets how many threads search each move (1, the default, is serial)
+void td_set_threads(int threads);
+
+#endif
@@ -0,0 +1,647 @@
+/******************************************************************************
+  Title          : tttevent.c
+  Author         : Andriy Goltsev
+  Description    : epoll loop over the public FIFO and the clients' FIFOs
+
+  Notes          : The sessions live in a slab (tttslab.h) of
+                   EV_MAX_SESSIONS records, or as many as -S lets run
+                   (tttadmit.h): the struct ev_session in one
+                   column, and the clocks that expire() and
+                   retry_replies() scan over every session in columns of
+                   their own, as do the flags of the sessions whose
+                   frames play_held() owes a turn. Opening and closing a
+                   session, and its first game, calls no malloc(). The epoll data of a
+                   client FIFO or socket is the handle of its session, so
+                   an event left in the batch after its session closed
+                   resolves to nothing; the public FIFO, the listening
+                   socket, the stats socket and the control socket of a
+                   pool worker (tttpool.h) are registered with the tags
+                   EV_PUBLIC to EV_CONTROL, which no handle equals.
+                   Frames (tttproto.h) are collected in a struct tp_reader
+                   per FIFO or socket until complete. On a socket the hello
+                   is the first message. Replies are queued in the session
+                   and written as soon as the client's end takes them.
+
+******************************************************************************/
+
+#define _GNU_SOURCE	// accept4()
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <syslog.h>
+#include "tttevent.h"
+#include "tttgame.h"
+#include "tttsock.h"
+#include "tttring.h"
+#include "tttproto.h"
+#include "tttstats.h"
+#include "tttpool.h"
+#include "tttsuper.h"
+#include "tttadmit.h"
+#include "tttslab.h"
+
+// epoll data of the sockets that are not sessions; handles have odd
+// generations, so none of them is 0 to 4
+enum {
+	EV_PUBLIC = 1,
+	EV_LISTEN,
+	EV_STATS,
+	EV_CONTROL
+};
+
+// the columns of the slab
+enum {
+	EV_RECORDS,		// struct ev_session
+	EV_STARTED,		// long long sv_now_ms() when it opened
+	EV_ACTIVE,		// long long sv_now_ms() of its last move
+	EV_PENDING,		// long long now_ms() since out_len > 0, 0 while not
+	EV_HELD,		// char 1 while frames wait past a wakeup's budget
+	EV_COLUMNS
+};
+
+struct ev_session {
+	sl_handle handle;
+	struct ttt_session session;	// the games of the client
+	int out_fd;			// read end of the client's out FIFO, or its socket
+	int in_fd;			// write end of its in FIFO (or the socket), or -1
+	int greeted;			// the hello has been received
+	uid_t uid;			// of a socket client, (uid_t) -1 otherwise
+	int ringed;			// moves travel on ring, see tttring.h
+	struct tr_end ring;
+	char in_fifo[MAX_FIFO_NAME + 1];	// where the replies go
+	struct tp_reader in;		// frames from the client
+	unsigned char out[TP_BUFFER];	// frames not written yet
+	int out_len;
+	long long since;		// st_now() when the client came
+	long long busy_ns;		// spent on its events
+} __attribute__((aligned(SL_LINE)));
+
+static int _epfd;
+static struct sl_slab _slab;		// the open sessions
+static struct ev_session* _records;	// its columns
+static long long *_started, *_active, *_pending;
+static char* _held;
+static int _nsessions;
+static int _npending;			// sessions with replies to write
+static int _nheld;			// sessions with frames held back
+static struct wp_load* _load;		// of a pool worker, NULL otherwise
+static struct ev_session* _current;	// whose event is being handled
+static long long _current_since;	// st_now() when it began
+static long long _last_tick;		// sv_now_ms() of the last expire()
+
+static long long now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+//the slot of s in the columns
+static unsigned slot(const struct ev_session* s)
+{
+	return s - _records;
+}
+
+static void close_session(struct ev_session* s)
+{
+	if (st_on()) {
+		if (s == _current) {
+			s->busy_ns += st_now() - _current_since;
+			_current = NULL;
+		}
+		st_time(ST_SESSION_CPU_NS, s->busy_ns);
+		st_time(ST_SESSION_KB, (sizeof(*s) + session_bytes(&s->session) + 1023) / 1024);
+	}
+	epoll_ctl(_epfd, EPOLL_CTL_DEL, s->out_fd, NULL);
+	close(s->out_fd);
+	if (s->in_fd != -1 && s->in_fd != s->out_fd)
+		close(s->in_fd);
+	if (s->ringed) {
+		epoll_ctl(_epfd, EPOLL_CTL_DEL, s->ring.in_bell, NULL);
+		tr_close(&s->ring);
+	}
+	if (s->out_len > 0) {
+		_pending[slot(s)] = 0;
+		_npending--;
+	}
+	if (_held[slot(s)]) {
+		_held[slot(s)] = 0;
+		_nheld--;
+	}
+	_nsessions--;
+	if (s->greeted)
+		session_end(&s->session);
+	if (_load)
+		__atomic_sub_fetch(&_load->sessions, 1, __ATOMIC_RELAXED);
+	sl_free(&_slab, s->handle);
+}
+
+//registers a session reading frames from fd for a client that came at
+//since; returns NULL on failure
+static struct ev_session* add_session(int fd, long long since)
+{
+	struct epoll_event ev;
+	struct ev_session* s;
+	sl_handle h;
+
+	if ((h = sl_alloc(&_slab)) == 0) {
+		syslog(LOG_WARNING, "all %u sessions taken, client dropped", _slab.capacity);
+		return NULL;
+	}
+	// the slot keeps its last session; only what that one changed is reset
+	s = &_records[sl_slot(h)];
+	s->handle = h;
+	s->out_fd = fd;
+	s->in_fd = -1;
+	s->greeted = s->ringed = 0;
+	s->uid = (uid_t) -1;
+	s->in_fifo[0] = '\0';
+	s->out_len = 0;
+	s->since = since;
+	s->busy_ns = 0;
+	tp_reader_init(&s->in);
+	_started[sl_slot(h)] = _active[sl_slot(h)] = sv_now_ms();
+	ev.events = EPOLLIN;
+	ev.data.u64 = h;
+	if (epoll_ctl(_epfd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+		sl_free(&_slab, h);
+		return NULL;
+	}
+	_nsessions++;
+	if (_load)
+		__atomic_add_fetch(&_load->sessions, 1, __ATOMIC_RELAXED);
+	return s;
+}
+
+//writes the queued frames; returns 1 if they are gone (or never will be),
+//0 to try again later
+static int flush(struct ev_session* s)
+{
+	long long start;
+	int written;
+
+	if (s->in_fd == -1 && (s->in_fd = tp_open_fifo(s->in_fifo, O_WRONLY | O_NONBLOCK)) == -1)
+		return errno != ENXIO;	// ENXIO: the client is not reading yet
+	// below PIPE_BUF, so the frames are written whole or not at all
+	start = st_on() ? st_now() : 0;
+	written = write(s->in_fd, s->out, s->out_len);
+	if (st_on())
+		st_time(ST_WRITE_NS, st_now() - start);
+	if (written == -1) {
+		if (errno == EAGAIN)
+			return 0;
+		if (errno == EPIPE)
+			syslog(LOG_INFO, "client of %s stopped reading", s->in_fifo);
+	}
+	return 1;
+}
+
+//the len bytes after out_len are frames for the client; writes them with
+//the ones still queued, or keeps them for retry_replies()
+static void queued(struct ev_session* s, int len)
+{
+	if (s->out_len == 0)
+		_pending[slot(s)] = now_ms();
+	else
+		_npending--;	// counted again below
+	s->out_len += len;
+	if (flush(s)) {
+		s->out_len = 0;
+		_pending[slot(s)] = 0;
+	}
+	else
+		_npending++;
+}
+
+static int greet(struct ev_session* s, const struct handshake* hndshk)
+{
+	struct tp_welcome welcome;
+
+	if (session_init(&s->session, hndshk) == -1)
+		return -1;
+	s->greeted = 1;
+	ttt_welcome(&s->session, s->ringed ? TRANSPORT_RING : TRANSPORT_STREAM, &welcome);
+	queued(s, tp_put_welcome(s->out + s->out_len, &welcome));
+	session_started(&s->session, s->ringed ? TRANSPORT_RING : TRANSPORT_STREAM, s->since);
+	return 0;
+}
+
+//marks s as having frames left in its reader that no event will bring up
+static void hold(struct ev_session* s, int held)
+{
+	if (_held[slot(s)] != held) {
+		_held[slot(s)] = held;
+		_nheld += held ? 1 : -1;
+	}
+}
+
+//plays the moves that have arrived on a FIFO or socket for EV_TURN_MS, or
+//one move if that takes longer; the replies go out in one write. What is
+//left is held for the next turn of the loop, like the moves of a ring after
+//EV_RING_MOVES, or waits for the client to take the replies
+static void play_frames(struct ev_session* s)
+{
+	int len;
+
+	len = session_play(&s->session, &s->in, s->out + s->out_len, TP_BUFFER - s->out_len, EV_TURN_MS);
+	if (len == -1) {
+		close_session(s);	// not this protocol
+		return;
+	}
+	if (len > 0)
+		queued(s, len);
+	hold(s, s->out_len == 0 && tp_pending(&s->in) > 0);
+}
+
+//gives the sessions with frames held back their next turn
+static void play_held(void)
+{
+	unsigned i;
+
+	for (i = 0; i < _slab.used && _nheld > 0; i++) {
+		if (!_held[i])
+			continue;
+		hold(&_records[i], 0);
+		if (st_on()) {
+			_current = &_records[i];
+			_current_since = st_now();
+			play_frames(_current);
+			if (_current)
+				_current->busy_ns += st_now() - _current_since;
+			_current = NULL;
+		}
+		else
+			play_frames(&_records[i]);
+	}
+}
+
+static void open_fifo_session(const struct handshake* hndshk, long long since)
+{
+	struct ev_session* s;
+	int fd;
+
+	// the client opened its out FIFO before sending the hello
+	if ((fd = tp_open_fifo(hndshk->client_out_fifo, O_RDONLY | O_NONBLOCK)) == -1)
+		return;
+	if ((s = add_session(fd, since)) == NULL) {
+		close(fd);
+		return;
+	}
+	// the reply channel stays open for the whole session; a client that
+	// has not opened its end yet gets it on the first reply
+	s->in_fd = tp_open_fifo(hndshk->client_in_fifo, O_WRONLY | O_NONBLOCK);
+	strcpy(s->in_fifo, hndshk->client_in_fifo);
+	if (greet(s, hndshk) == -1)
+		close_session(s);
+}
+
+//registers the non-blocking connection fd; its hello comes as a move
+static void add_socket(int fd, long long since)
+{
+	struct ev_session* s;
+
+	if ((s = add_session(fd, since)) == NULL) {
+		close(fd);
+		return;
+	}
+	s->in_fd = fd;
+	s->uid = us_peer_uid(fd);
+}
+
+//opens the session of a client admitted by tttadmit.h
+static void start(const struct ad_client* c)
+{
+	if (c->fd != -1)
+		add_socket(c->fd, c->since);
+	else
+		open_fifo_session(&c->hello, c->since);
+}
+
+static void on_connect(int listensock)
+{
+	struct ad_client c;
+
+	while ((c.fd = accept4(listensock, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1) {
+		c.since = st_now();
+		if (ad_admit(&c, _nsessions) == AD_ADMIT)
+			start(&c);
+	}
+}
+
+//answers the moves on the ring, then sleeps until the client rings again.
+//After EV_RING_MOVES it rings its own bell instead, so that the other
+//clients of the loop get their turn before the rest
+static void on_ring(struct ev_session* s)
+{
+	struct move client_mv, server_mv;
+	long long start;
+	int moves = 0;
+	char c;
+
+	// after the hello nothing but EOF may come on the socket; what is left
+	// unread there would wake the loop forever
+	if (recv(s->out_fd, &c, 1, MSG_DONTWAIT) != -1 || errno != EAGAIN) {
+		close_session(s);
+		return;
+	}
+	tr_woken(&s->ring);
+	do {
+		while (tr_pop(&s->ring, &client_mv)) {
+			ttt_play(session_game(&s->session, 0), &client_mv, &server_mv);
+			start = st_on() ? st_now() : 0;
+			if (tr_push(&s->ring, &server_mv) == -1) {
+				close_session(s);	// the client stopped taking replies
+				return;
+			}
+			if (st_on())
+				st_time(ST_WRITE_NS, st_now() - start);
+			if (++moves == EV_RING_MOVES) {
+				tr_rewake(&s->ring);
+				return;
+			}
+		}
+	} while (tr_sleep(&s->ring));
+}
+
+static void close_fds(int* fds, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		if (fds[i] != -1)
+			close(fds[i]);
+}
+
+static void on_hello(struct ev_session* s)
+{
+	struct handshake hndshk;
+	struct epoll_event ev;
+	const unsigned char* frame;
+	int passed[3];	// a bot's shared-memory rings
+	int n, len;
+
+	if ((n = tp_fill(&s->in, s->out_fd, passed, 3)) == -1 && errno == EAGAIN)
+		return;
+	if (n <= 0 || (len = tp_next(&s->in, &frame)) <= 0 ||
+	    tp_get_hello(frame, len, &hndshk) == -1) {
+		close_fds(passed, 3);
+		close_session(s);
+		return;
+	}
+	if (hndshk.transport == TRANSPORT_RING && tr_attach(&s->ring, passed) == 0) {
+		// the client's bell wakes the loop; tr_attach() made it
+		// non-blocking
+		ev.events = EPOLLIN;
+		ev.data.u64 = s->handle;
+		if (epoll_ctl(_epfd, EPOLL_CTL_ADD, s->ring.in_bell, &ev) == -1) {
+			tr_close(&s->ring);
+			close_session(s);
+			return;
+		}
+		s->ringed = 1;
+	}
+	else
+		close_fds(passed, 3);
+	syslog(LOG_INFO, "socket client uid %ld", (long) s->uid);
+	if (greet(s, &hndshk) == -1) {
+		close_session(s);
+		return;
+	}
+	if (s->ringed)
+		on_ring(s);	// the first moves may be waiting already
+	else
+		play_frames(s);
+}
+
+static void on_move(struct ev_session* s)
+{
+	int n;
+
+	_active[slot(s)] = sv_now_ms();
+	if (!s->greeted) {
+		on_hello(s);
+		return;
+	}
+	if (s->ringed) {
+		on_ring(s);
+		return;
+	}
+	// play_held() comes to it; a read into a reader not empty could cut a
+	// socket's message short
+	if (_held[slot(s)])
+		return;
+
+	if ((n = tp_fill(&s->in, s->out_fd, NULL, 0)) == -1 && errno == EAGAIN)
+		return;
+	if (n <= 0) {	// EOF: the client quit
+		close_session(s);
+		return;
+	}
+	play_frames(s);
+}
+
+static void retry_replies(void)
+{
+	struct ev_session* s;
+	long long now = now_ms();
+	unsigned i;
+
+	for (i = 0; i < _slab.used && _npending > 0; i++) {
+		if (_pending[i] == 0)
+			continue;
+		s = &_records[i];
+		if (flush(s)) {
+			s->out_len = 0;
+			_pending[i] = 0;
+			_npending--;
+			play_frames(s);	// moves held back while the queue was full
+		}
+		else if (now - _pending[i] >= EV_REPLY_TRIES * 1000LL)
+			close_session(s);	// never accessed its private FIFO
+	}
+}
+
+//collects the hellos waiting on the public FIFO
+static void on_handshake(int publicfifo)
+{
+	static struct tp_reader hellos;
+	struct ad_client c;
+	const unsigned char* frame;
+	int len;
+
+	c.fd = -1;
+	while (tp_fill(&hellos, publicfifo, NULL, 0) > 0) {
+		c.since = st_now();
+		while ((len = tp_next(&hellos, &frame)) > 0)
+			if (tp_get_hello(frame, len, &c.hello) == 0 && ad_admit(&c, _nsessions) == AD_ADMIT)
+				start(&c);
+		if (len == -1) {
+			syslog(LOG_WARNING, "garbage on %s dropped", PUBLIC);
+			tp_reader_init(&hellos);
+		}
+	}
+}
+
+//closes the sessions past the supervisor's limits
+static void expire(long long now)
+{
+	unsigned i;
+
+	for (i = 0; i < _slab.used; i++)
+		if (sl_live(&_slab, i) && sv_expired(_started[i], _active[i], now)) {
+			st_count(ST_TIMEOUTS, 1);
+			close_session(&_records[i]);
+		}
+}
+
+//takes the clients the dispatcher has handed over; returns 0 once the
+//dispatcher is gone
+static int on_handoff(int control)
+{
+	unsigned char buf[sizeof(struct wp_handoff) + sizeof(struct handshake)];
+	struct wp_handoff h;
+	struct handshake hndshk;
+	int n, fd;
+
+	while ((n = us_recv_fds(control, buf, sizeof(buf), &fd, 1)) > 0) {
+		__atomic_sub_fetch(&_load->pending, 1, __ATOMIC_RELAXED);
+		memcpy(&h, buf, (size_t) n < sizeof(h) ? (size_t) n : sizeof(h));	// n > 0 here
+		if (n >= (int) sizeof(h) && h.kind == WP_SOCKET && fd != -1)
+			add_socket(fd, h.since);
+		else {
+			if (fd != -1)
+				close(fd);
+			if (n == sizeof(h) + sizeof(hndshk) && h.kind == WP_FIFO) {
+				memcpy(&hndshk, buf + sizeof(h), sizeof(hndshk));
+				open_fifo_session(&hndshk, h.since);
+			}
+		}
+	}
+	return n == -1 && errno == EAGAIN;
+}
+
+//runs the loop over what has been registered with _epfd
+static int serve(int publicfifo, int listensock, int statsock, int control)
+{
+	struct epoll_event events[EV_MAX_EVENTS];
+	struct ad_client c;
+	long long now;
+	int i, n;
+	sl_handle tag;
+
+	for (;;) {
+		if (sv_stopping)
+			return 0;
+		n = epoll_wait(_epfd, events, EV_MAX_EVENTS,
+			       _nheld ? 0 : ad_waiting() ? AD_POLL_MS : _npending ? EV_RETRY_MS : SV_TICK_MS);
+		if (n == -1) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		for (i = 0; i < n; i++) {
+			tag = events[i].data.u64;
+			if (tag == EV_PUBLIC)
+				on_handshake(publicfifo);
+			else if (tag == EV_LISTEN)
+				on_connect(listensock);
+			else if (tag == EV_STATS)
+				st_serve(statsock);
+			else if (tag == EV_CONTROL) {
+				if (!on_handoff(control))
+					return 0;
+			}
+			else if (!sl_resolves(&_slab, tag))
+				continue;	// its session was closed
+			else if (st_on()) {
+				_current = &_records[sl_slot(tag)];
+				_current_since = st_now();
+				on_move(_current);
+				if (_current)
+					_current->busy_ns += st_now() - _current_since;
+				_current = NULL;
+			}
+			else
+				on_move(&_records[sl_slot(tag)]);
+		}
+		if (_npending)
+			retry_replies();
+		if (_nheld)
+			play_held();
+		// the workers of a pool leave admission to the dispatcher
+		while (publicfifo != -1 && ad_dequeue(&c, _nsessions))
+			start(&c);
+		if ((now = sv_now_ms()) - _last_tick >= SV_TICK_MS) {
+			_last_tick = now;
+			expire(now);
+			if (publicfifo != -1)
+				sv_sweep(now);	// once per server, not per worker
+		}
+	}
+}
+
+//maps the slab of sessions and creates the epoll instance
+static int init(void)
+{
+	size_t columns[EV_COLUMNS];
+	unsigned capacity = ad_max_sessions > 0 ? ad_max_sessions : EV_MAX_SESSIONS;
+
+	columns[EV_RECORDS] = sizeof(struct ev_session);
+	columns[EV_STARTED] = columns[EV_ACTIVE] = columns[EV_PENDING] = sizeof(long long);
+	columns[EV_HELD] = sizeof(char);
+	if (sl_init(&_slab, capacity, columns, EV_COLUMNS) == -1)
+		return -1;
+	_records = _slab.column[EV_RECORDS];
+	_started = _slab.column[EV_STARTED];
+	_active = _slab.column[EV_ACTIVE];
+	_pending = _slab.column[EV_PENDING];
+	_held = _slab.column[EV_HELD];
+	return _epfd = epoll_create1(EPOLL_CLOEXEC);
+}
+
+int ev_run(int publicfifo, int listensock, int statsock)
+{
+	struct epoll_event ev;
+
+	if (init() == -1)
+		return -1;
+	if (fcntl(publicfifo, F_SETFL, fcntl(publicfifo, F_GETFL) | O_NONBLOCK) == -1)
+		return -1;
+	ev.events = EPOLLIN;
+	ev.data.u64 = EV_PUBLIC;
+	if (epoll_ctl(_epfd, EPOLL_CTL_ADD, publicfifo, &ev) == -1)
+		return -1;
+	if (listensock != -1) {
+		if (fcntl(listensock, F_SETFL, fcntl(listensock, F_GETFL) | O_NONBLOCK) == -1)
+			return -1;
+		ev.data.u64 = EV_LISTEN;
+		if (epoll_ctl(_epfd, EPOLL_CTL_ADD, listensock, &ev) == -1)
+			return -1;
+	}
+	ev.data.u64 = EV_STATS;
+	if (statsock != -1 && epoll_ctl(_epfd, EPOLL_CTL_ADD, statsock, &ev) == -1)
+		return -1;
+	return serve(publicfifo, listensock, statsock, -1);
+}
+
+int ev_worker(int control, struct wp_load* load)
+{
+	struct epoll_event ev;
+
+	_load = load;
+	if (init() == -1)
+		return -1;
+	if (fcntl(control, F_SETFL, fcntl(control, F_GETFL) | O_NONBLOCK) == -1)
+		return -1;
+	ev.events = EPOLLIN;
+	ev.data.u64 = EV_CONTROL;
+	if (epoll_ctl(_epfd, EPOLL_CTL_ADD, control, &ev) == -1)
+		return -1;
+	return serve(-1, -1, -1, control);
+}
@@ -0,0 +1,45 @@
+/******************************************************************************
+  Title          : tttevent.h
+  Author         : Andriy Goltsev
+  Description    : Single-process event loop serving every client
+
+  Notes          : The alternative to forking a process per client
+                   (tttserver -e). One process waits with epoll on the
+                   public FIFO, the listening sockets (tttsock.h,
+                   tttstats.h) and the private FIFO or connection of every
+                   client, and keeps each game in a struct ttt_game. The reply FIFO of a
+                   client is opened once and kept for the whole session. A
+                   reply that cannot be delivered yet, because the client
+                   has not opened its read end, is retried from the loop for
+                   up to EV_REPLY_TRIES seconds instead of sleeping.
+                   The workers of the pool (tttserver -w, tttpool.h) run
+                   the same loop over the clients handed to them.
+                   Sessions past the limits of tttsuper.h are closed once
+                   per SV_TICK_MS.
+
+******************************************************************************/
+
+#ifndef TTTEVENT_H
+#define TTTEVENT_H
+
+#define EV_MAX_EVENTS	64	// events taken from epoll at once
+#define EV_RETRY_MS	10	// interval of reply retries
+#define EV_REPLY_TRIES	5	// seconds a reply may wait for its reader
+#define EV_MAX_SESSIONS	16384	// open at once, unless -S is lower
+#define EV_RING_MOVES	64	// moves of a ring answered per wakeup
+#define EV_TURN_MS	20	// after which the frames of a session wait a turn
+
+//serves clients on publicfifo and, unless it is -1, on the listening Unix
+//socket listensock until an error, and the stats on statsock (tttstats.h)
+//unless it is -1; returns -1 with errno set, or 0 once sv_stopping is set
+//(tttsuper.h)
+int ev_run(int publicfifo, int listensock, int statsock);
+
+struct wp_load;
+
+//serves the clients the dispatcher hands over on control, counting them in
+//load, until the dispatcher is gone or sv_stopping is set (0) or an error
+//(-1 with errno set)
+int ev_worker(int control, struct wp_load* load);
+
+#endif
@@ -0,0 +1,345 @@
+/******************************************************************************
+  Title          : tttgame.c
+  Author         : Andriy Goltsev
+  Description    : Player side of the server: rules and engine selection
+
+******************************************************************************/
+
+#include <stdlib.h>
+#include <syslog.h>
+#include "tttgame.h"
+#include "tttsearch.h"
+#include "tttbook.h"
+#include "tttdeep.h"
+#include "tttstats.h"
+#include "tttlog.h"
+#include "tttrecord.h"
+
+long ttt_budget_ms = TD_BUDGET_MS;
+size_t ttt_session_arena = TTT_SESSION_ARENA;
+
+void clear_board(struct ttt_game* game){
+	if (game->engine == ENGINE_MCTS && game->mcts.arena.peak > 0)
+		syslog(LOG_INFO, "MCTS game over, tree peaked at %zu of %zu bytes",
+		       game->mcts.arena.peak, game->mcts.arena.size);
+	tm_reset(&game->mcts); // the whole tree goes in one step
+	tg_clear(&game->board);
+}
+
+void init_new_game(struct ttt_game* game, const struct handshake* hndshk){
+	game->server_char = hndshk->server_char;
+	game->client_char = hndshk->client_char;
+	game->level = hndshk->level;
+	game->budget_ms = ttt_budget_ms;
+	game->engine = hndshk->engine == ENGINE_MCTS ? ENGINE_MCTS : ENGINE_SEARCH;
+	tm_init(&game->mcts);
+	game->id = 0;
+	game->session = 0;
+	game->bad_geometry = tg_init(&game->board,
+		hndshk->rows ? hndshk->rows : BOARD_SIZE,
+		hndshk->cols ? hndshk->cols : BOARD_SIZE,
+		hndshk->win_len ? hndshk->win_len : WIN_LENGTH) == -1;
+}
+
+void ttt_welcome(struct ttt_session* session, int transport, struct tp_welcome* w){
+	const struct ttt_game* game = session_game(session, 0);
+
+	w->version = session->settings.version < TP_VERSION ? session->settings.version : TP_VERSION;
+	w->status = game->bad_geometry ? INVALID_BOARD : STATUS_OK;
+	w->engine = game->engine;
+	w->transport = transport;
+	w->max_side = MAX_BOARD_SIZE;
+	w->max_games = TTT_MAX_GAMES;
+}
+
+void session_started(struct ttt_session* session, int transport, long long since){
+	const struct handshake* h = &session->settings;
+	const struct ttt_game* game = session->games[0];
+	struct lg_record r;
+	long long spent = st_now() - since;
+
+	st_count(ST_HANDSHAKES, 1);
+	st_time(ST_HANDSHAKE_NS, spent);
+	if(!lg_on())
+		return;
+	memset(&r, 0, sizeof(r));
+	r.type = LG_SESSION_START;
+	r.session = session->id;
+	r.row = game->board.rows;
+	r.col = game->board.cols;
+	r.server_row = game->board.k;
+	r.server_col = h->level;
+	r.status = game->bad_geometry ? INVALID_BOARD : STATUS_OK;
+	r.spent_ns = spent > UINT32_MAX ? UINT32_MAX : spent;
+	r.value = game->engine | transport << 8;
+	lg_append(&r);
+}
+
+void end_game(struct ttt_game* game){
+	tm_release(&game->mcts);
+}
+
+static void log_move(const struct ttt_game* game, const struct move* client_mv,
+		     const struct move* server_mv, long long think){
+	struct lg_record r;
+
+	if(!lg_on())
+		return;
+	r.type = LG_MOVE;
+	r.session = game->session;
+	r.game = game->id;
+	r.status = server_mv->status;
+	r.row = client_mv->row;
+	r.col = client_mv->col;
+	r.server_row = server_mv->row;
+	r.server_col = server_mv->col;
+	r.spent_ns = think > UINT32_MAX ? UINT32_MAX : think;
+	r.value = 0;
+	lg_append(&r);
+}
+
+static void log_game_end(const struct ttt_game* game, int status, int moves){
+	struct lg_record r;
+
+	memset(&r, 0, sizeof(r));
+	r.type = LG_GAME_END;
+	r.session = game->session;
+	r.game = game->id;
+	r.status = status;
+	r.value = moves;
+	lg_append(&r);
+}
+
+void ttt_play(struct ttt_game* game, const struct move* client_mv, struct move* server_mv){
+	struct ttt_grid* board = &game->board;
+	long long start, think = 0;
+	int moves;
+
+	st_count(ST_MOVES, 1);
+	server_mv->row = server_mv->col = 0; //unless the server moves
+	if(game->bad_geometry){
+		server_mv->status = INVALID_BOARD;
+		st_count(ST_INVALID_MOVES, 1);
+		log_move(game, client_mv, server_mv, 0);
+		return;
+	}
+	if((server_mv->status = validMove(game, client_mv)) == STATUS_OK){ //check if the move can be made
+		tg_apply(board, TB_CLIENT, tg_cell(board, client_mv->row, client_mv->col)); //place client's piece on TTT matrix
+		game->history[board->moves - 1] = tg_cell(board, client_mv->row, client_mv->col);
+	}
+	else {
+		st_count(ST_INVALID_MOVES, 1);
+		log_move(game, client_mv, server_mv, 0);
+		return;
+	}
+	
+	if((server_mv->status = ttt_status(game)) == STATUS_OK){ //check again the status
+		start = st_on() || lg_on() ? st_now() : 0;
+		counterAttack(game, server_mv); // if user didnt win, counter attack
+		if(start){
+			think = st_now() - start;
+			st_time(ST_THINK_NS, think);
+		}
+		server_mv->status = ttt_status(game); //set servers_move to new status
+	}
+	log_move(game, client_mv, server_mv, think);
+      
+        if(server_mv->status == TIED || server_mv->status == CLIENT_WINS || server_mv->status == SERVER_WINS){
+		st_count(server_mv->status == TIED ? ST_TIES :
+			 server_mv->status == CLIENT_WINS ? ST_CLIENT_WINS : ST_SERVER_WINS, 1);
+		moves = board->moves;
+		if(gr_on())
+			gr_add(game, server_mv->status);
+		clear_board(game);
+		if(lg_on())
+			log_game_end(game, server_mv->status, moves);
+	}
+	
+}
+
+int validMove(const struct ttt_game* game, const struct move* client_mv){
+	const struct ttt_grid* board = &game->board;
+
+	if( 0 <= client_mv->row && board->rows > client_mv->row && 
+		0 <= client_mv->col && board->cols > client_mv->col &&
+			tg_is_empty(board, tg_cell(board, client_mv->row, client_mv->col)))
+				return STATUS_OK;
+	else return INVALID_MOVE;
+}
+
+// the winner is tracked by tg_apply() through the lines of each new piece
+int ttt_status(const struct ttt_game* game)
+{
+	if(game->board.winner == TB_SERVER)
+		return SERVER_WINS;
+	if(game->board.winner == TB_CLIENT)
+		return CLIENT_WINS;
+	if(tg_is_full(&game->board))
+		return TIED;
+	return STATUS_OK;
+}
+
+
+void counterAttack(struct ttt_game* game, struct move* new_move)
+{
+	struct ttt_grid* board = &game->board;
+	struct ttt_board classic;
+	int cell, outcome;
+
+	cell = TB_NO_CELL;
+	if (game->engine == ENGINE_MCTS && game->level > TS_LEVEL_FIRST_EMPTY)
+		cell = tm_best_move(&game->mcts, board, TB_SERVER, game->budget_ms);
+	else if (game->level >= TS_LEVEL_PERFECT && tg_is_classic(board)) {
+		classic = tg_classic(board);
+		cell = bk_best_move(&classic, TB_SERVER, &outcome);
+	}
+	else if (!tg_is_classic(board))
+		cell = td_best_move(board, TB_SERVER, game->level, game->budget_ms);
+	if (cell == TB_NO_CELL && (cell = ts_grid_move(board, TB_SERVER, game->level)) == TB_NO_CELL)
+		return;
+	tg_apply(board, TB_SERVER, cell);
+	game->history[board->moves - 1] = cell;
+	new_move->row = cell / board->cols;
+	new_move->col = cell % board->cols;
+}
+
+/************************************************************************/
+/*                       Session                                        */
+/************************************************************************/
+
+int session_init(struct ttt_session* session, const struct handshake* hndshk){
+	session->settings = *hndshk;
+	session->one = NULL;
+	session->games = &session->one;
+	session->size = 1;
+	session->arenas = 0;
+	session->id = lg_on() ? lg_new_session() : 0;
+	return session_game(session, 0) == NULL ? -1 : 0;
+}
+
+struct ttt_game* session_game(struct ttt_session* session, int id){
+	struct ttt_game** grown;
+	int size;
+
+	if(id < 0 || id >= TTT_MAX_GAMES)
+		return NULL;
+	if(id >= session->size){ // the table doubles, games are allocated one by one
+		for(size = session->size ? session->size : 1; size <= id; size *= 2)
+			;
+		if((grown = realloc(session->games == &session->one ? NULL : session->games,
+				    size * sizeof(*grown))) == NULL)
+			return NULL;
+		if(session->games == &session->one)
+			grown[0] = session->one;
+		memset(grown + session->size, 0, (size - session->size) * sizeof(*grown));
+		session->games = grown;
+		session->size = size;
+	}
+	if(session->games[id] == NULL){
+		if(id == 0)
+			session->games[id] = &session->first;
+		else if((session->games[id] = malloc(sizeof(struct ttt_game))) == NULL)
+			return NULL;
+		init_new_game(session->games[id], &session->settings);
+		// 4096 games of 16 MB trees would be too much for one client
+		if(session->games[id]->engine == ENGINE_MCTS){
+			if(session->arenas > 0 && session->arenas + tm_arena_limit() > ttt_session_arena)
+				session->games[id]->engine = ENGINE_SEARCH;
+			else
+				session->arenas += tm_arena_limit();
+		}
+		session->games[id]->id = id;
+		session->games[id]->session = session->id;
+		st_count(ST_GAMES_ACTIVE, 1);
+	}
+	return session->games[id];
+}
+
+void session_end(struct ttt_session* session){
+	struct lg_record r;
+	int id, games = 0;
+
+	for(id = 0; id < session->size; id++)
+		if(session->games[id] != NULL){
+			games++;
+			if(gr_on() && session->games[id]->board.moves > 0)
+				gr_add(session->games[id], STATUS_OK); // cut short
+		}
+	if(gr_on())
+		gr_flush();
+	if(lg_on()){
+		memset(&r, 0, sizeof(r));
+		r.type = LG_SESSION_END;
+		r.session = session->id;
+		r.value = games;
+		lg_append(&r);
+	}
+	for(id = 0; id < session->size; id++)
+		if(session->games[id] != NULL){
+			end_game(session->games[id]);
+			if(session->games[id] != &session->first)
+				free(session->games[id]);
+			st_count(ST_GAMES_ACTIVE, -1);
+		}
+	if(session->games != &session->one)
+		free(session->games);
+	session->games = NULL;
+	session->size = 0;
+}
+
+size_t session_bytes(const struct ttt_session* session){
+	size_t bytes = session->games == &session->one ? 0 : session->size * sizeof(*session->games);
+	int id;
+
+	// game 0 and the table of one are in the session itself
+	for(id = 0; id < session->size; id++)
+		if(session->games[id] != NULL)
+			bytes += (id > 0 ? sizeof(struct ttt_game) : 0) + session->games[id]->mcts.arena.high;
+	return bytes;
+}
+
+int session_play(struct ttt_session* session, struct tp_reader* r, unsigned char* out, int space,
+		 long turn_ms){
+	const unsigned char* frame;
+	struct ttt_game* game;
+	struct move client_mv, server_mv;
+	int len, id, used = 0;
+	long long deadline = st_now() + turn_ms * 1000000LL;
+	long budget = ttt_budget_ms;
+
+	// a reply is as long as its move, so a frame is taken only if it fits
+	while((len = tp_pending(r)) > 0 && used + len <= space){
+		if(turn_ms > 0){
+			if(used > 0 && st_now() >= deadline)
+				break;
+			// the moves buffered share the budget, as if every frame
+			// were a move, the shortest kind
+			budget = ttt_budget_ms / (tp_buffered(r) / TP_MOVE_BYTES);
+			if(budget < TTT_MIN_THINK_MS)
+				budget = TTT_MIN_THINK_MS < ttt_budget_ms ? TTT_MIN_THINK_MS : ttt_budget_ms;
+		}
+		tp_next(r, &frame);
+		if(tp_type(frame) == TP_MOVE){
+			if(tp_get_move(frame, len, &client_mv) == -1)
+				return -1;
+			game = session_game(session, 0);
+			game->budget_ms = budget;
+			ttt_play(game, &client_mv, &server_mv);
+			used += tp_put_move(out + used, &server_mv);
+		}
+		else if(tp_get_game_move(frame, len, &id, &client_mv) == 0){
+			if((game = session_game(session, id)) == NULL){
+				server_mv.status = INVALID_BOARD; // no such game
+				server_mv.row = server_mv.col = 0;
+			}
+			else {
+				game->budget_ms = budget;
+				ttt_play(game, &client_mv, &server_mv);
+			}
+			used += tp_put_game_move(out + used, id, &server_mv);
+		}
+		else
+			return -1;
+	}
+	return len == -1 ? -1 : used;
+}
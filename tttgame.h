@@ -0,0 +1,113 @@
+/******************************************************************************
+  Title          : tttgame.h
+  Author         : Andriy Goltsev
+  Description    : State and rules of one game played by the server
+
+  Notes          : Everything a game needs lives in struct ttt_game, so a
+                   server process can hold one game (fork mode) or many of
+                   them (event mode, see tttevent.h). The games a client
+                   plays over one connection form a struct ttt_session. The settings shared by
+                   all games of the server, such as the time budget of a
+                   move, are process-wide.
+
+******************************************************************************/
+
+#ifndef TTTGAME_H
+#define TTTGAME_H
+
+#include "ttt.h"
+#include "tttgrid.h"
+#include "tttmcts.h"
+#include "tttproto.h"
+
+struct ttt_game {
+	struct ttt_grid board;		// t-t-t matrix, one bitmask per side
+	int bad_geometry;		// the client asked for a board the server cannot play
+	int engine;			// ENGINE_SEARCH or ENGINE_MCTS, chosen by the client
+	int level;			// search depth requested by the client
+	long budget_ms;			// think time of the next server move
+	int server_char, client_char;
+	struct tm_tree mcts;		// tree of the MCTS engine
+	unsigned char history[TG_MAX_CELLS];	// cells in the order played, see tttrecord.h
+	int id;				// in its session
+	unsigned session;		// number of the session in the event log
+};
+
+#define TTT_MAX_GAMES	4096	// games of one session, ids 0 to TTT_MAX_GAMES - 1
+#define TTT_SESSION_ARENA	(64 << 20)	// default MCTS arenas of one session
+#define TTT_MIN_THINK_MS	10	// least think time of a move that shares a budget
+
+// the games a client plays over one connection
+struct ttt_session {
+	struct handshake settings;	// every game starts from the hello
+	struct ttt_game** games;	// by id, created on their first move
+	int size;
+	unsigned id;			// lg_new_session() if the event log is on
+	size_t arenas;			// MCTS arena bytes its games may reserve
+	struct ttt_game first;		// game 0, so that a session of one game
+	struct ttt_game* one;		// (and its table) allocates nothing
+};
+
+//time budget of a server move on large boards, in milliseconds
+extern long ttt_budget_ms;
+
+//bytes of MCTS arenas the games of one session may reserve together. A game
+//that asks for MCTS past them plays with the search engine instead; the
+//first always gets its arena
+extern size_t ttt_session_arena;
+
+//initializes a new game from the client's handshake; an unknown engine is
+//replaced by ENGINE_SEARCH
+void init_new_game(struct ttt_game* game, const struct handshake* hndshk);
+
+//starts a session with game 0; returns -1 if out of memory. The session
+//points into itself and must not be copied
+int session_init(struct ttt_session* session, const struct handshake* hndshk);
+
+//returns game id of the session, starting it if needed, or NULL if id is out
+//of range or there is no memory
+struct ttt_game* session_game(struct ttt_session* session, int id);
+
+//ends every game of the session
+void session_end(struct ttt_session* session);
+
+//bytes the games of the session hold outside the struct, MCTS trees at the
+//largest they have been
+size_t session_bytes(const struct ttt_session* session);
+
+//plays the move frames that are complete in r and appends the replies to out
+//as long as they fit in space; returns the bytes appended, or -1 if a frame
+//is not a move. Unless turn_ms is 0, the moves buffered share ttt_budget_ms,
+//TTT_MIN_THINK_MS at least each, and the frames left once turn_ms has passed
+//stay in r for the next call: a client sending many moves at once holds the
+//event loop for one of them at a time. With 0 every move thinks for
+//ttt_budget_ms and every frame that fits is taken
+int session_play(struct ttt_session* session, struct tp_reader* r, unsigned char* out, int space,
+		 long turn_ms);
+
+//fills in the server's answer to the hello of the session
+void ttt_welcome(struct ttt_session* session, int transport, struct tp_welcome* w);
+
+//counts and logs the session once its welcome is written; since is when the
+//hello came (st_now())
+void session_started(struct ttt_session* session, int transport, long long since);
+
+//releases what the game holds; the struct can then be freed
+void end_game(struct ttt_game* game);
+
+//empties the board for the next game
+void clear_board(struct ttt_game* game);
+
+//returns the status of the game: TIED, USER_WINS etc. See ttt.h
+int ttt_status(const struct ttt_game* game);
+
+//counter attacks the user
+void counterAttack(struct ttt_game* game, struct move* new_move);
+
+//return STATUS_OK if the move is valid
+int validMove(const struct ttt_game* game, const struct move* client_mv);
+
+//given client_mv sets up server_mv 
+void ttt_play(struct ttt_game* game, const struct move* client_mv, struct move* server_mv);
+
+#endif
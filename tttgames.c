@@ -0,0 +1,297 @@
+/******************************************************************************
+  Title          : tttgames.c
+  Author         : Andriy Goltsev
+  Description    : Replays and analyzes the game records of tttserver
+
+  Build with     : make tttgames
+
+  Usage          : tttgames [-n openings] [-v] gamefile...
+                   Maps the record files written by tttserver -g (see
+                   tttrecord.h) and replays every game through the engine
+                   functions of tttgame.h: each move must be valid and the
+                   last status must be the result recorded. Games are
+                   grouped by board, level and engine, and for each group
+                   prints the share of every result, the -n most frequent
+                   openings (the client's first move and the server's
+                   reply, 3 by default) and the server's blunders. On the
+                   classic board a blunder is a move that turns a won game
+                   into a tie or loss, or a tie into a loss, as searched by
+                   tttsearch; on larger boards it is a missed win in one or
+                   a missed block of the client's win in one. -v prints
+                   each game that does not replay.
+
+******************************************************************************/
+
+#include <time.h>
+#include "ttt.h"
+#include "tttgame.h"
+#include "tttrecord.h"
+#include "tttsearch.h"
+
+#define MAX_GROUPS	256
+
+struct group {
+	int rows, cols, k, level, engine;
+	long games, moves, server_moves;
+	long result[4];			// by result, STATUS_OK for cut short
+	long blunders;			// classic board
+	long missed_wins, missed_blocks;	// larger boards
+	unsigned* openings;		// first cell * (cells + 1) + reply
+};
+
+static struct group _groups[MAX_GROUPS];
+static int _ngroups;
+static int _top = 3, _verbose;
+static long _bad;
+static signed char _value[2][19683];	// ts_value() sign + 2, 0 if not known
+
+static long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static struct group* group_of(const struct gr_game* g)
+{
+	struct group* gr;
+	int i, cells = g->rows * g->cols;
+
+	for (i = 0; i < _ngroups; i++) {
+		gr = &_groups[i];
+		if (gr->rows == g->rows && gr->cols == g->cols && gr->k == g->k &&
+		    gr->level == g->level && gr->engine == g->engine)
+			return gr;
+	}
+	if (_ngroups == MAX_GROUPS)
+		return NULL;
+	gr = &_groups[_ngroups++];
+	gr->rows = g->rows;
+	gr->cols = g->cols;
+	gr->k = g->k;
+	gr->level = g->level;
+	gr->engine = g->engine;
+	if ((gr->openings = calloc(cells * (cells + 1), sizeof(*gr->openings))) == NULL) {
+		perror("calloc");
+		exit(1);
+	}
+	return gr;
+}
+
+//game-theoretic value of the classic board for side to move: 1, 0 or -1
+static int classic_value(const struct ttt_grid* grid, int side)
+{
+	struct ttt_board b = tg_classic(grid);
+	int cell, index = 0, v;
+
+	for (cell = TB_CELLS - 1; cell >= 0; cell--)
+		index = index * 3 + ((b.side[TB_SERVER] >> cell) & 1) + 2 * ((b.side[TB_CLIENT] >> cell) & 1);
+	if (_value[side][index] == 0) {
+		v = ts_value(&b, side);
+		_value[side][index] = (v > 0) - (v < 0) + 2;
+	}
+	return _value[side][index] - 2;
+}
+
+//1 if side has a win in one on g
+static int has_win(const struct ttt_grid* g, int side)
+{
+	int cell;
+
+	for (cell = tg_next_empty(g, 0); cell != TB_NO_CELL; cell = tg_next_empty(g, cell + 1))
+		if (tg_makes_line(g, side, cell))
+			return 1;
+	return 0;
+}
+
+//judges the server's move cell on game->board before it is played
+static void judge(struct group* gr, const struct ttt_game* game, int cell)
+{
+	const struct ttt_grid* b = &game->board;
+	struct ttt_grid after;
+	int before, value;
+
+	if (tg_is_classic(b)) {
+		before = classic_value(b, TB_SERVER);
+		after = *b;
+		tg_apply(&after, TB_SERVER, cell);
+		if (after.winner == TB_SERVER)
+			value = 1;
+		else if (tg_is_full(&after))
+			value = 0;
+		else
+			value = -classic_value(&after, TB_CLIENT);
+		gr->blunders += value < before;
+		return;
+	}
+	if (tg_makes_line(b, TB_SERVER, cell))
+		return;
+	if (has_win(b, TB_SERVER))
+		gr->missed_wins++;
+	else if (has_win(b, TB_CLIENT) && !tg_makes_line(b, TB_CLIENT, cell))
+		gr->missed_blocks++;
+}
+
+//replays g; returns 0 if every move is valid and the result is right
+static int replay(const struct gr_game* g)
+{
+	struct handshake hndshk;
+	struct ttt_game game;
+	struct move mv;
+	struct group* gr;
+	int i, side, status = STATUS_OK, cells = g->rows * g->cols;
+
+	if ((gr = group_of(g)) == NULL)
+		return -1;
+	memset(&hndshk, 0, sizeof(hndshk));
+	hndshk.rows = g->rows;
+	hndshk.cols = g->cols;
+	hndshk.win_len = g->k;
+	hndshk.level = g->level;
+	hndshk.engine = g->engine;
+	init_new_game(&game, &hndshk);
+	if (game.bad_geometry)
+		return -1;
+
+	for (i = 0; i < g->moves; i++) {
+		side = i % 2 == 0 ? TB_CLIENT : TB_SERVER;
+		mv.row = g->cell[i] / g->cols;
+		mv.col = g->cell[i] % g->cols;
+		if (status != STATUS_OK || validMove(&game, &mv) != STATUS_OK)
+			return -1;
+		if (side == TB_SERVER)
+			judge(gr, &game, g->cell[i]);
+		tg_apply(&game.board, side, g->cell[i]);
+		status = ttt_status(&game);
+	}
+	if (status != g->result)
+		return -1;
+
+	gr->games++;
+	gr->moves += g->moves;
+	gr->server_moves += g->moves / 2;
+	gr->result[g->result]++;
+	if (g->moves > 0)
+		gr->openings[g->cell[0] * (cells + 1) + (g->moves > 1 ? g->cell[1] : cells)]++;
+	return 0;
+}
+
+static void print_game(const struct gr_game* g)
+{
+	int i;
+
+	printf("bad game %dx%d k=%d level %d result %d:", g->rows, g->cols, g->k, g->level, g->result);
+	for (i = 0; i < g->moves; i++)
+		printf(" %d,%d", g->cell[i] / g->cols, g->cell[i] % g->cols);
+	printf("\n");
+}
+
+//returns the games in the file, or -1 if it cannot be read
+static long analyze(const char* path)
+{
+	struct gr_file f;
+	struct gr_game g;
+	const unsigned char *p, *end;
+	long games = 0;
+	int b, len;
+
+	if (gr_map(path, &f) == -1) {
+		perror(path);
+		return -1;
+	}
+	for (b = 0; b < f.nblocks; b++) {
+		p = f.base + f.blocks[b].offset + sizeof(struct gr_block);
+		end = p + f.blocks[b].bytes;
+		for (; p < end; p += len, games++) {
+			if ((len = gr_decode(p, end, &g)) == -1) {
+				_bad++;	// the rest of the block cannot be found
+				break;
+			}
+			if (replay(&g) == -1) {
+				_bad++;
+				if (_verbose)
+					print_game(&g);
+			}
+		}
+	}
+	gr_unmap(&f);
+	return games;
+}
+
+static void print_group(const struct group* gr)
+{
+	static const char* results[4] = { "cut short", "tie", "client", "server" };
+	int i, j, best, cells = gr->rows * gr->cols;
+	unsigned* counts;
+
+	printf("%dx%d k=%d level %d %s: %ld games, %.1f moves per game\n", gr->rows, gr->cols, gr->k,
+	       gr->level, gr->engine == ENGINE_MCTS ? "mcts" : "search", gr->games,
+	       gr->games ? (double) gr->moves / gr->games : 0.0);
+	printf("  results:");
+	for (i = 1; i <= 4; i++)
+		printf("  %s %.1f%%", results[i % 4], gr->games ? 100.0 * gr->result[i % 4] / gr->games : 0.0);
+	printf("\n  openings:");
+
+	// the top ones are taken out of a copy one by one
+	if ((counts = malloc(cells * (cells + 1) * sizeof(*counts))) == NULL) {
+		perror("malloc");
+		exit(1);
+	}
+	memcpy(counts, gr->openings, cells * (cells + 1) * sizeof(*counts));
+	for (i = 0; i < _top; i++) {
+		for (j = 0, best = 0; j < cells * (cells + 1); j++)
+			if (counts[j] > counts[best])
+				best = j;
+		if (counts[best] == 0)
+			break;
+		printf("  %d,%d", best / (cells + 1) / gr->cols, best / (cells + 1) % gr->cols);
+		if (best % (cells + 1) < cells)
+			printf(" %d,%d", best % (cells + 1) / gr->cols, best % (cells + 1) % gr->cols);
+		printf(" %.1f%%", 100.0 * counts[best] / gr->games);
+		counts[best] = 0;
+	}
+	free(counts);
+	printf("\n");
+	if (gr->rows == 3 && gr->cols == 3 && gr->k == 3)
+		printf("  blunders: %ld in %ld server moves\n", gr->blunders, gr->server_moves);
+	else
+		printf("  blunders: %ld missed wins, %ld missed blocks in %ld server moves\n",
+		       gr->missed_wins, gr->missed_blocks, gr->server_moves);
+}
+
+int main(int argc, char* argv[])
+{
+	long long start;
+	long games = 0, n;
+	double elapsed;
+	int opt, i;
+
+	while ((opt = getopt(argc, argv, "n:v")) != -1) {
+		switch (opt) {
+			case 'n': _top = atoi(optarg); break;
+			case 'v': _verbose = 1; break;
+			default:
+				fprintf(stderr, "usage: %s [-n openings] [-v] gamefile...\n", argv[0]);
+				exit(1);
+		}
+	}
+	if (optind == argc) {
+		fprintf(stderr, "usage: %s [-n openings] [-v] gamefile...\n", argv[0]);
+		exit(1);
+	}
+
+	start = now_ns();
+	for (i = optind; i < argc; i++) {
+		if ((n = analyze(argv[i])) == -1)
+			exit(1);
+		games += n;
+	}
+	elapsed = (now_ns() - start) / 1e9;
+
+	for (i = 0; i < _ngroups; i++)
+		print_group(&_groups[i]);
+	printf("%ld games in %.2f s (%.0f games/s), %ld do not replay\n", games, elapsed,
+	       elapsed > 0 ? games / elapsed : 0.0, _bad);
+	return _bad ? 2 : 0;
+}
@@ -0,0 +1,83 @@
+/******************************************************************************
+  Title          : tttgen.c
+  Author         : Andriy Goltsev
+  Description    : Offline generator of the perfect-play book for tttserver
+
+  Build with     : make tttgen
+
+  Usage          : tttgen [bookfile]
+                   Walks every position reachable from the empty board,
+                   searches each one to the end with tttsearch and writes
+                   the best reply and the outcome of every canonical
+                   position to bookfile (ttt.book by default). See tttbook.h
+                   for the format.
+
+******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tttbook.h"
+#include "tttsearch.h"
+#include "ttthash.h"
+
+static unsigned char _book[BK_ENTRIES];
+static unsigned char _seen[BK_ENTRIES];
+static int _positions;
+
+static void walk(struct ttt_board* b, int side)
+{
+	struct bk_pos pos;
+	ttt_mask empty;
+	int cell, value, outcome;
+
+	bk_canonical(b->side[side], b->side[!side], &pos);
+	if (_seen[pos.index])
+		return;
+	_seen[pos.index] = 1;
+
+	cell = ts_best_move(b, side, TS_LEVEL_PERFECT);
+	value = ts_value(b, side);
+	outcome = value > 0 ? BK_WIN : value < 0 ? BK_LOSS : BK_DRAW;
+	_book[pos.index] = BK_ENTRY(th_to_canonical(pos.sym, cell), outcome);
+	_positions++;
+
+	empty = tb_legal(b);
+	while (empty) {
+		cell = tb_first(empty);
+		empty &= empty - 1;
+		tb_apply(b, side, cell);
+		if (!tb_has_line(b->side[side]) && !tb_is_full(b))
+			walk(b, !side);
+		tb_undo(b, side, cell);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	const char* path = argc > 1 ? argv[1] : BK_DEFAULT;
+	struct bk_header hdr;
+	struct ttt_board b;
+	FILE* out;
+
+	th_init();
+	tb_clear(&b);
+	walk(&b, TB_CLIENT);
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, BK_MAGIC, 4);
+	hdr.version = BK_VERSION;
+	hdr.entries = BK_ENTRIES;
+
+	if ((out = fopen(path, "wb")) == NULL) {
+		perror(path);
+		exit(1);
+	}
+	if (fwrite(&hdr, sizeof(hdr), 1, out) != 1 ||
+	    fwrite(_book, sizeof(_book), 1, out) != 1 || fclose(out) != 0) {
+		perror(path);
+		exit(1);
+	}
+	printf("%s: %d canonical positions\n", path, _positions);
+	return 0;
+}
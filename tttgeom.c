@@ -0,0 +1,57 @@
+/******************************************************************************
+  Title          : tttgeom.c
+  Author         : Andriy Goltsev
+  Description    : Instantiates the specialized geometry engines
+
+  Notes          : tttgeom.inc is generated by tttgeomgen; for every
+                   geometry R x C, k-in-a-row it defines
+                       tg_lines_R_C_K[], tg_line_start_R_C_K[]  (word boards)
+                       tg_neighbors_R_C_K[]
+
+******************************************************************************/
+
+#include <stddef.h>
+#include "tttgeom.h"
+#include "tttgeom.inc"
+
+#define TG_NAME(prefix, R, C, K)	prefix##_##R##_##C##_##K
+
+#define TG_WORD_ENGINE(R, C, K) \
+static int TG_NAME(makes_line, R, C, K)(const tg_bits* m, int cell) \
+{ \
+	const uint64_t* line = TG_NAME(tg_lines, R, C, K) + TG_NAME(tg_line_start, R, C, K)[cell]; \
+	const uint64_t* end = TG_NAME(tg_lines, R, C, K) + TG_NAME(tg_line_start, R, C, K)[cell + 1]; \
+	uint64_t pieces = m->w[0] | 1ULL << cell; \
+	for (; line < end; line++) \
+		if ((pieces & *line) == *line) \
+			return 1; \
+	return 0; \
+}
+
+#define TG_WIDE_ENGINE(R, C, K) \
+static int TG_NAME(makes_line, R, C, K)(const tg_bits* m, int cell) \
+{ \
+	return tg_line_through(m, cell, R, C, K); \
+}
+
+#define TG_DESCRIPTOR(R, C, K) \
+	{ R, C, K, TG_NAME(makes_line, R, C, K), TG_NAME(tg_neighbors, R, C, K) },
+
+TG_WORD_GEOMETRIES(TG_WORD_ENGINE)
+TG_WIDE_GEOMETRIES(TG_WIDE_ENGINE)
+
+static const struct tg_geometry _geometries[] = {
+	TG_WORD_GEOMETRIES(TG_DESCRIPTOR)
+	TG_WIDE_GEOMETRIES(TG_DESCRIPTOR)
+};
+
+const struct tg_geometry* tg_find_geometry(int rows, int cols, int k)
+{
+	size_t i;
+
+	for (i = 0; i < sizeof(_geometries) / sizeof(_geometries[0]); i++)
+		if (_geometries[i].rows == rows && _geometries[i].cols == cols &&
+		    _geometries[i].k == k)
+			return &_geometries[i];
+	return NULL;
+}
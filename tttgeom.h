@@ -0,0 +1,52 @@
+/******************************************************************************
+  Title          : tttgeom.h
+  Author         : Andriy Goltsev
+  Description    : Engines specialized for common board geometries
+
+  Notes          : Every geometry listed below gets its own copy of the win
+                   test with rows, cols and k as compile-time constants, and
+                   its own constant tables: the k-windows through each cell
+                   (boards of up to 64 cells) and the neighbours of each
+                   cell. The tables are written to tttgeom.inc by tttgeomgen
+                   when the server is built. tg_init() looks the geometry up
+                   once per game, so the hot path makes one indirect call
+                   into code that is as tight as a hand-written 3x3 check.
+
+                   To add a geometry, add it to one of the two lists.
+
+******************************************************************************/
+
+#ifndef TTTGEOM_H
+#define TTTGEOM_H
+
+#include "tttgrid.h"
+
+// geometries of at most 64 cells: a win is a match against a window mask
+#define TG_WORD_GEOMETRIES(X) \
+	X(3, 3, 3) \
+	X(4, 4, 3) \
+	X(4, 4, 4) \
+	X(5, 5, 4) \
+	X(6, 6, 4) \
+	X(7, 7, 5) \
+	X(8, 8, 5)
+
+// larger geometries: a win is counted along the four lines of the cell
+#define TG_WIDE_GEOMETRIES(X) \
+	X(10, 10, 5) \
+	X(15, 15, 5) \
+	X(16, 16, 5)
+
+struct tg_geometry {
+	int rows, cols, k;
+
+	//returns non zero if a piece on cell makes k in a row with the pieces of m
+	int (*makes_line)(const tg_bits* m, int cell);
+
+	const tg_bits* neighbors;	// [cell] the up to eight cells around cell
+};
+
+//returns the specialized engine for the geometry or NULL
+const struct tg_geometry* tg_find_geometry(int rows, int cols, int k);
+
+#endif
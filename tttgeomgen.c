@@ -0,0 +1,106 @@
+/******************************************************************************
+  Title          : tttgeomgen.c
+  Author         : Andriy Goltsev
+  Description    : Generates the constant tables of the geometry engines
+
+  Build with     : make tttgeom.inc
+
+  Usage          : tttgeomgen > tttgeom.inc
+                   Writes, for every geometry listed in tttgeom.h, the
+                   k-windows through each cell and the neighbours of each
+                   cell as C initializers.
+
+******************************************************************************/
+
+#include <stdio.h>
+#include "tttgeom.h"
+
+static void print_bits(const tg_bits* m)
+{
+	int w;
+
+	printf("{{ ");
+	for (w = 0; w < TG_WORDS; w++)
+		printf("0x%llxULL%s", (unsigned long long) m->w[w], w + 1 < TG_WORDS ? ", " : "");
+	printf(" }}");
+}
+
+//every k-window of the board that contains cell, as one-word masks
+static void word_lines(int rows, int cols, int k)
+{
+	static const int dr[4] = { 0, 1, 1, 1 };
+	static const int dc[4] = { 1, 0, 1, -1 };
+	int cell, d, i, r, c, start = 0, n;
+	uint64_t mask;
+
+	printf("static const uint64_t tg_lines_%d_%d_%d[] = {\n", rows, cols, k);
+	for (cell = 0; cell < rows * cols; cell++) {
+		printf("\t");
+		for (d = 0; d < 4; d++) {
+			// windows of direction d starting i steps before cell
+			for (i = 0; i < k; i++) {
+				mask = 0;
+				for (n = 0; n < k; n++) {
+					r = cell / cols + (n - i) * dr[d];
+					c = cell % cols + (n - i) * dc[d];
+					if (r < 0 || r >= rows || c < 0 || c >= cols)
+						break;
+					mask |= 1ULL << (r * cols + c);
+				}
+				if (n == k)
+					printf("0x%llxULL, ", (unsigned long long) mask);
+			}
+		}
+		printf("\n");
+	}
+	printf("};\n");
+
+	printf("static const unsigned short tg_line_start_%d_%d_%d[] = {\n\t", rows, cols, k);
+	for (cell = 0; cell <= rows * cols; cell++) {
+		printf("%d, ", start);
+		if (cell == rows * cols)
+			break;
+		for (d = 0; d < 4; d++)
+			for (i = 0; i < k; i++) {
+				for (n = 0; n < k; n++) {
+					r = cell / cols + (n - i) * dr[d];
+					c = cell % cols + (n - i) * dc[d];
+					if (r < 0 || r >= rows || c < 0 || c >= cols)
+						break;
+				}
+				start += n == k;
+			}
+	}
+	printf("\n};\n");
+}
+
+static void neighbors(int rows, int cols, int k)
+{
+	tg_bits m;
+	int cell, r, c, w;
+
+	printf("static const tg_bits tg_neighbors_%d_%d_%d[] = {\n", rows, cols, k);
+	for (cell = 0; cell < rows * cols; cell++) {
+		for (w = 0; w < TG_WORDS; w++)
+			m.w[w] = 0;
+		for (r = cell / cols - 1; r <= cell / cols + 1; r++)
+			for (c = cell % cols - 1; c <= cell % cols + 1; c++)
+				if (r >= 0 && r < rows && c >= 0 && c < cols && r * cols + c != cell)
+					tg_set(&m, r * cols + c);
+		printf("\t");
+		print_bits(&m);
+		printf(",\n");
+	}
+	printf("};\n");
+}
+
+#define GEN_WORD(R, C, K)	word_lines(R, C, K); neighbors(R, C, K);
+#define GEN_WIDE(R, C, K)	neighbors(R, C, K);
+
+int main(void)
+{
+	printf("/* Generated by tttgeomgen from the lists in tttgeom.h. Do not edit. */\n\n");
+	TG_WORD_GEOMETRIES(GEN_WORD)
+	TG_WIDE_GEOMETRIES(GEN_WIDE)
+	return 0;
+}
@@ -0,0 +1,101 @@
+/******************************************************************************
+  Title          : tttgrid.c
+  Author         : Andriy Goltsev
+  Description    : rows x cols, k-in-a-row bitboard
+
+******************************************************************************/
+
+#include <string.h>
+#include "tttgrid.h"
+#include "tttgeom.h"
+
+int tg_init(struct ttt_grid* g, int rows, int cols, int k)
+{
+	int cell;
+
+	if (rows < 1 || rows > TG_MAX_SIDE || cols < 1 || cols > TG_MAX_SIDE ||
+	    k < 1 || (k > rows && k > cols))
+		return -1;
+	g->geom = tg_find_geometry(rows, cols, k);
+	g->rows = rows;
+	g->cols = cols;
+	g->k = k;
+	g->cells = rows * cols;
+	memset(&g->all, 0, sizeof(g->all));
+	for (cell = 0; cell < g->cells; cell++)
+		tg_set(&g->all, cell);
+	tg_clear(g);
+	return 0;
+}
+
+void tg_clear(struct ttt_grid* g)
+{
+	memset(g->side, 0, sizeof(g->side));
+	memset(&g->occupied, 0, sizeof(g->occupied));
+	g->moves = 0;
+	g->winner = TG_NONE;
+}
+
+int tg_makes_line(const struct ttt_grid* g, int side, int cell)
+{
+	if (g->geom)
+		return g->geom->makes_line(&g->side[side], cell);
+	return tg_line_through(&g->side[side], cell, g->rows, g->cols, g->k);
+}
+
+void tg_apply(struct ttt_grid* g, int side, int cell)
+{
+	tg_set(&g->side[side], cell);
+	tg_set(&g->occupied, cell);
+	g->moves++;
+	if (g->winner == TG_NONE && tg_makes_line(g, side, cell))
+		g->winner = side;
+}
+
+void tg_undo(struct ttt_grid* g, int side, int cell)
+{
+	tg_reset(&g->side[side], cell);
+	tg_reset(&g->occupied, cell);
+	g->moves--;
+	if (g->winner == side)
+		g->winner = TG_NONE;	// only the last move can have won
+}
+
+void tg_frontier(const struct ttt_grid* g, tg_bits* out)
+{
+	uint64_t pieces;
+	int w, cell, r, c, nr, nc;
+
+	memset(out, 0, sizeof(*out));
+	for (w = 0; w < TG_WORDS; w++) {
+		for (pieces = g->occupied.w[w]; pieces; pieces &= pieces - 1) {
+			cell = (w << 6) + __builtin_ctzll(pieces);
+			if (g->geom) {
+				for (nr = 0; nr < TG_WORDS; nr++)
+					out->w[nr] |= g->geom->neighbors[cell].w[nr];
+				continue;
+			}
+			r = cell / g->cols;
+			c = cell % g->cols;
+			for (nr = r - 1; nr <= r + 1; nr++)
+				for (nc = c - 1; nc <= c + 1; nc++)
+					if (nr >= 0 && nr < g->rows && nc >= 0 && nc < g->cols)
+						tg_set(out, tg_cell(g, nr, nc));
+		}
+	}
+	for (w = 0; w < TG_WORDS; w++)
+		out->w[w] &= ~g->occupied.w[w];
+}
+
+int tg_next_empty(const struct ttt_grid* g, int cell)
+{
+	uint64_t free;
+	int w;
+
+	for (w = cell >> 6; w < TG_WORDS && cell < g->cells; w++, cell = w << 6) {
+		free = g->all.w[w] & ~g->occupied.w[w] & (~0ULL << (cell & 63));
+		if (free)
+			return (w << 6) + __builtin_ctzll(free);
+	}
+	return TB_NO_CELL;
+}
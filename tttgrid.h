@@ -0,0 +1,136 @@
+/******************************************************************************
+  Title          : tttgrid.h
+  Author         : Andriy Goltsev
+  Description    : Bitboard for rows x cols boards with k-in-a-row wins
+
+  Notes          : The grid generalizes tttboard.h to any board up to
+                   TG_MAX_SIDE x TG_MAX_SIDE. Cells are numbered in
+                   row-major order and stored in TG_WORDS 64-bit words, so
+                   the classic 3x3 board lives in the low nine bits of the
+                   first word, exactly as a struct ttt_board (tg_classic()).
+
+                   Win detection is incremental: tg_apply() only counts the
+                   pieces on the four lines through the cell just played,
+                   which is O(k) whatever the size of the board, and keeps
+                   the result in winner. tg_undo() is only meant to take
+                   back the last move applied. Common geometries have
+                   specialized engines (tttgeom.h) that tg_init() attaches
+                   to the grid; other sizes use the same code with the
+                   geometry read at run time.
+
+******************************************************************************/
+
+#ifndef TTTGRID_H
+#define TTTGRID_H
+
+#include <stdint.h>
+#include "tttboard.h"
+
+#define TG_MAX_SIDE	16
+#define TG_MAX_CELLS	(TG_MAX_SIDE * TG_MAX_SIDE)
+#define TG_WORDS	(TG_MAX_CELLS / 64)
+#define TG_NONE		-1	// no winner yet
+
+typedef struct {
+	uint64_t w[TG_WORDS];
+} tg_bits;
+
+struct tg_geometry;
+
+struct ttt_grid {
+	const struct tg_geometry* geom;	// specialized engine or NULL
+	int rows, cols;
+	int k;			// pieces in a row needed to win
+	int cells;		// rows * cols
+	int moves;		// pieces on the board
+	int winner;		// TB_SERVER, TB_CLIENT or TG_NONE
+	tg_bits side[2];	// pieces of TB_SERVER and TB_CLIENT
+	tg_bits occupied;
+	tg_bits all;		// every cell of the board
+};
+
+static inline int tg_test(const tg_bits* m, int cell){
+	return (m->w[cell >> 6] >> (cell & 63)) & 1;
+}
+
+static inline void tg_set(tg_bits* m, int cell){
+	m->w[cell >> 6] |= 1ULL << (cell & 63);
+}
+
+static inline void tg_reset(tg_bits* m, int cell){
+	m->w[cell >> 6] &= ~(1ULL << (cell & 63));
+}
+
+//pieces of m next to (r, c) in direction (dr, dc), at most k - 1
+static inline __attribute__((always_inline))
+int tg_run(const tg_bits* m, int r, int c, int dr, int dc, int rows, int cols, int k){
+	int n = 0;
+
+	for (r += dr, c += dc; n < k - 1; r += dr, c += dc, n++)
+		if (r < 0 || r >= rows || c < 0 || c >= cols || !tg_test(m, r * cols + c))
+			break;
+	return n;
+}
+
+//returns non zero if a piece on cell makes k in a row with the pieces of m.
+//Always inlined, so that callers passing constant rows, cols and k get the
+//loops unrolled and the divisions folded.
+static inline __attribute__((always_inline))
+int tg_line_through(const tg_bits* m, int cell, int rows, int cols, int k){
+	int r = cell / cols, c = cell % cols;
+
+	return 1 + tg_run(m, r, c, 0, 1, rows, cols, k) + tg_run(m, r, c, 0, -1, rows, cols, k) >= k ||
+	       1 + tg_run(m, r, c, 1, 0, rows, cols, k) + tg_run(m, r, c, -1, 0, rows, cols, k) >= k ||
+	       1 + tg_run(m, r, c, 1, 1, rows, cols, k) + tg_run(m, r, c, -1, -1, rows, cols, k) >= k ||
+	       1 + tg_run(m, r, c, 1, -1, rows, cols, k) + tg_run(m, r, c, -1, 1, rows, cols, k) >= k;
+}
+
+static inline int tg_cell(const struct ttt_grid* g, int r, int c){
+	return r * g->cols + c;
+}
+
+static inline int tg_is_empty(const struct ttt_grid* g, int cell){
+	return !tg_test(&g->occupied, cell);
+}
+
+static inline int tg_is_full(const struct ttt_grid* g){
+	return g->moves == g->cells;
+}
+
+//true for the geometry handled by the 3x3 engines (search, book)
+static inline int tg_is_classic(const struct ttt_grid* g){
+	return g->rows == 3 && g->cols == 3 && g->k == 3;
+}
+
+//the 3x3 grid g as a struct ttt_board
+static inline struct ttt_board tg_classic(const struct ttt_grid* g){
+	struct ttt_board b;
+
+	b.side[TB_SERVER] = (ttt_mask) g->side[TB_SERVER].w[0];
+	b.side[TB_CLIENT] = (ttt_mask) g->side[TB_CLIENT].w[0];
+	b.occupied = (ttt_mask) g->occupied.w[0];
+	return b;
+}
+
+//sets up an empty rows x cols board; returns -1 if the geometry is invalid
+int tg_init(struct ttt_grid* g, int rows, int cols, int k);
+
+//empties the board keeping its geometry
+void tg_clear(struct ttt_grid* g);
+
+//returns non zero if a piece of side on cell would make k in a row
+int tg_makes_line(const struct ttt_grid* g, int side, int cell);
+
+//places a piece of side on the empty cell and updates winner
+void tg_apply(struct ttt_grid* g, int side, int cell);
+
+//takes back the last piece placed by tg_apply()
+void tg_undo(struct ttt_grid* g, int side, int cell);
+
+//sets out to the empty cells next to any piece on the board
+void tg_frontier(const struct ttt_grid* g, tg_bits* out);
+
+//next empty cell at or after cell, or TB_NO_CELL
+int tg_next_empty(const struct ttt_grid* g, int cell);
+
+#endif
@@ -0,0 +1,145 @@
+/******************************************************************************
+  Title          : ttthash.c
+  Author         : Andriy Goltsev
+  Description    : Zobrist hashed, symmetry canonical transposition table
+
+  Notes          : Both the symmetry permutation of a whole mask and the
+                   Zobrist hash of a whole mask are looked up in 512 entry
+                   tables, so canonicalizing a position costs sixteen table
+                   reads and no loop over the cells.
+
+******************************************************************************/
+
+#include <string.h>
+#include "ttthash.h"
+
+static int _ready;
+static int _frozen;
+static unsigned char _sym[TH_SYMS][TB_CELLS];	// cell -> canonical cell
+static unsigned char _inv[TH_SYMS][TB_CELLS];	// canonical cell -> cell
+static unsigned short _perm[TH_SYMS][TB_FULL + 1];	// mask -> transformed mask
+static uint64_t _zobrist[2][TB_FULL + 1];	// [0] side to move, [1] opponent
+static struct th_entry _table[TH_SIZE];
+
+//the new (row, col) of (r, c) under each of the eight symmetries
+static void sym_cell(int sym, int r, int c, int* nr, int* nc)
+{
+	switch (sym) {
+		case 0: *nr = r;     *nc = c;     break;	// identity
+		case 1: *nr = c;     *nc = 2 - r; break;	// rotate 90
+		case 2: *nr = 2 - r; *nc = 2 - c; break;	// rotate 180
+		case 3: *nr = 2 - c; *nc = r;     break;	// rotate 270
+		case 4: *nr = r;     *nc = 2 - c; break;	// mirror left-right
+		case 5: *nr = 2 - r; *nc = c;     break;	// mirror up-down
+		case 6: *nr = c;     *nc = r;     break;	// main diagonal
+		default: *nr = 2 - c; *nc = 2 - r; break;	// anti diagonal
+	}
+}
+
+//splitmix64, gives the same keys on every run
+static uint64_t next_key(uint64_t* state)
+{
+	uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+void th_init(void)
+{
+	uint64_t state = 0x5454545454545454ULL;
+	uint64_t keys[2][TB_CELLS];
+	int s, cell, r, c, m, p;
+
+	if (_ready)
+		return;
+
+	for (s = 0; s < TH_SYMS; s++) {
+		for (cell = 0; cell < TB_CELLS; cell++) {
+			sym_cell(s, TB_ROW(cell), TB_COL(cell), &r, &c);
+			_sym[s][cell] = TB_CELL(r, c);
+			_inv[s][TB_CELL(r, c)] = cell;
+		}
+	}
+
+	for (p = 0; p < 2; p++)
+		for (cell = 0; cell < TB_CELLS; cell++)
+			keys[p][cell] = next_key(&state);
+
+	for (m = 0; m <= TB_FULL; m++) {
+		for (s = 0; s < TH_SYMS; s++) {
+			_perm[s][m] = 0;
+			for (cell = 0; cell < TB_CELLS; cell++)
+				if (m & TB_BIT(cell))
+					_perm[s][m] |= TB_BIT(_sym[s][cell]);
+		}
+		for (p = 0; p < 2; p++) {
+			_zobrist[p][m] = 0;
+			for (cell = 0; cell < TB_CELLS; cell++)
+				if (m & TB_BIT(cell))
+					_zobrist[p][m] ^= keys[p][cell];
+		}
+	}
+
+	memset(_table, 0, sizeof(_table));
+	_ready = 1;
+}
+
+void th_canonical(ttt_mask mine, ttt_mask theirs, struct th_pos* pos)
+{
+	uint64_t key;
+	int s;
+
+	pos->key = _zobrist[0][mine] ^ _zobrist[1][theirs];
+	pos->sym = 0;
+	for (s = 1; s < TH_SYMS; s++) {
+		key = _zobrist[0][_perm[s][mine]] ^ _zobrist[1][_perm[s][theirs]];
+		if (key < pos->key) {
+			pos->key = key;
+			pos->sym = s;
+		}
+	}
+}
+
+const struct th_entry* th_probe(uint64_t key)
+{
+	const struct th_entry* e = &_table[key & (TH_SIZE - 1)];
+
+	return (e->flag && e->key == key) ? e : NULL;
+}
+
+void th_store(uint64_t key, int value, int depth, int flag, int move)
+{
+	struct th_entry* e = &_table[key & (TH_SIZE - 1)];
+
+	if (_frozen)
+		return;
+	// keep exact results, they are what the server's root probes look for
+	if (e->flag == TH_EXACT && e->key != key && flag != TH_EXACT)
+		return;
+	e->key = key;
+	e->value = value;
+	e->depth = depth;
+	e->flag = flag;
+	e->move = move;
+}
+
+void th_freeze(void)
+{
+	_frozen = 1;
+}
+
+int th_to_canonical(int sym, int cell)
+{
+	return _sym[sym][cell];
+}
+
+int th_from_canonical(int sym, int cell)
+{
+	return _inv[sym][cell];
+}
+
+ttt_mask th_transform(int sym, ttt_mask m)
+{
+	return _perm[sym][m & TB_FULL];
+}
@@ -0,0 +1,68 @@
+/******************************************************************************
+  Title          : ttthash.h
+  Author         : Andriy Goltsev
+  Description    : Transposition table for the move search
+
+  Notes          : Positions are keyed from the point of view of the side to
+                   move (its pieces and the opponent's pieces), so the same
+                   entry serves the server whichever side it is on. The key
+                   is the smallest Zobrist hash over the eight symmetries of
+                   the board, which folds rotated and mirrored positions
+                   into one entry. Moves are stored in canonical cells and
+                   have to be mapped back with th_from_canonical().
+
+                   The server fills the table before it starts forking and
+                   then freezes it, so every child shares the parent's pages
+                   and never writes to them.
+
+******************************************************************************/
+
+#ifndef TTTHASH_H
+#define TTTHASH_H
+
+#include <stdint.h>
+#include "tttboard.h"
+
+#define TH_SIZE		4096	// number of entries, a power of two
+#define TH_SYMS		8
+
+#define TH_EXACT	1
+#define TH_LOWER	2	// value is a lower bound (search failed high)
+#define TH_UPPER	3	// value is an upper bound (search failed low)
+
+struct th_entry {
+	uint64_t key;
+	signed char value;
+	unsigned char depth;
+	unsigned char flag;
+	unsigned char move;	// best move, canonical cell
+};
+
+struct th_pos {
+	uint64_t key;		// canonical Zobrist key
+	int sym;		// symmetry that maps the board onto its canonical form
+};
+
+//builds the Zobrist keys and symmetry tables; may be called more than once
+void th_init(void);
+
+//computes the canonical key of the position mine/theirs with mine to move
+void th_canonical(ttt_mask mine, ttt_mask theirs, struct th_pos* pos);
+
+//returns the entry stored under key or NULL
+const struct th_entry* th_probe(uint64_t key);
+
+//stores a search result; does nothing once the table is frozen
+void th_store(uint64_t key, int value, int depth, int flag, int move);
+
+//turns the table read-only
+void th_freeze(void);
+
+//maps cell to/from the canonical board of symmetry sym
+int th_to_canonical(int sym, int cell);
+int th_from_canonical(int sym, int cell);
+
+//applies symmetry sym to every cell of m
+ttt_mask th_transform(int sym, ttt_mask m);
+
+#endif
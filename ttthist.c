@@ -0,0 +1,90 @@
+/******************************************************************************
+  Title          : ttthist.c
+  Author         : Andriy Goltsev
+  Description    : Log-linear latency histograms
+
+  Notes          : Values below HS_SUB have a bucket each. Above, the
+                   bucket is the position of the top bit and the HS_SUB_BITS
+                   bits after it.
+
+******************************************************************************/
+
+#include <string.h>
+#include "ttthist.h"
+
+static int bucket(uint64_t v)
+{
+	int top;
+
+	if (v < HS_SUB)
+		return v;
+	top = 63 - __builtin_clzll(v);
+	return (top - HS_SUB_BITS + 1) * HS_SUB + ((v >> (top - HS_SUB_BITS)) & (HS_SUB - 1));
+}
+
+//the largest value that falls in bucket b
+static uint64_t bucket_top(int b)
+{
+	int shift;
+
+	if (b < HS_SUB)
+		return b;
+	shift = b / HS_SUB - 1;
+	return ((uint64_t) (HS_SUB + b % HS_SUB + 1) << shift) - 1;
+}
+
+void hs_clear(struct ttt_hist* h)
+{
+	memset(h, 0, sizeof(*h));
+}
+
+void hs_add(struct ttt_hist* h, uint64_t value)
+{
+	h->count[bucket(value)]++;
+	h->n++;
+	h->sum += value;
+	if (value > h->max)
+		h->max = value;
+}
+
+void hs_add_shared(struct ttt_hist* h, uint64_t value)
+{
+	uint64_t max = __atomic_load_n(&h->max, __ATOMIC_RELAXED);
+
+	__atomic_add_fetch(&h->count[bucket(value)], 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&h->n, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&h->sum, value, __ATOMIC_RELAXED);
+	while (value > max && !__atomic_compare_exchange_n(&h->max, &max, value, 1,
+							     __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+}
+
+void hs_merge(struct ttt_hist* dst, const struct ttt_hist* src)
+{
+	int b;
+
+	for (b = 0; b < HS_BUCKETS; b++)
+		dst->count[b] += src->count[b];
+	dst->n += src->n;
+	dst->sum += src->sum;
+	if (src->max > dst->max)
+		dst->max = src->max;
+}
+
+uint64_t hs_percentile(const struct ttt_hist* h, double p)
+{
+	uint64_t rank, seen = 0;
+	int b;
+
+	if (h->n == 0)
+		return 0;
+	rank = (uint64_t) (p * h->n);
+	if (rank >= h->n)
+		rank = h->n - 1;
+	for (b = 0; b < HS_BUCKETS; b++) {
+		seen += h->count[b];
+		if (seen > rank)
+			return bucket_top(b) < h->max ? bucket_top(b) : h->max;
+	}
+	return h->max;
+}
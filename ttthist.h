@@ -0,0 +1,45 @@
+/******************************************************************************
+  Title          : ttthist.h
+  Author         : Andriy Goltsev
+  Description    : Log-linear latency histograms
+
+  Notes          : Values (nanoseconds, or any other unit) fall into
+                   HS_SUB buckets per power of two, so a percentile read
+                   back is within 1/HS_SUB of the true value while the
+                   whole histogram stays a fixed, small array that is cheap
+                   to add to and to merge.
+
+******************************************************************************/
+
+#ifndef TTTHIST_H
+#define TTTHIST_H
+
+#include <stdint.h>
+
+#define HS_SUB_BITS	4
+#define HS_SUB		(1 << HS_SUB_BITS)	// buckets per power of two
+#define HS_BUCKETS	((64 - HS_SUB_BITS + 1) * HS_SUB)
+
+struct ttt_hist {
+	uint64_t count[HS_BUCKETS];
+	uint64_t n;		// values added
+	uint64_t sum;
+	uint64_t max;
+};
+
+void hs_clear(struct ttt_hist* h);
+
+//adds one value
+void hs_add(struct ttt_hist* h, uint64_t value);
+
+//adds one value with atomic operations, for a histogram that several threads
+//or processes add to at once
+void hs_add_shared(struct ttt_hist* h, uint64_t value);
+
+//adds every value of src to dst
+void hs_merge(struct ttt_hist* dst, const struct ttt_hist* src);
+
+//the value below which a fraction p (0 to 1) of the values fall; 0 if empty
+uint64_t hs_percentile(const struct ttt_hist* h, double p);
+
+#endif
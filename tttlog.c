@@ -0,0 +1,293 @@
+/******************************************************************************
+  Title          : tttlog.c
+  Author         : Andriy Goltsev
+  Description    : Binary event log of the server
+
+  Notes          : head and tail of a ring only grow; a slot is
+                   head % LG_RING_RECORDS. Writers of all processes running
+                   on one CPU share its ring, so a slot is reserved with a
+                   compare-and-swap of head, and the flusher takes records
+                   in order up to the first one whose seq is not yet set.
+                   A slot that stays reserved for LG_STUCK_PASSES passes
+                   belonged to a process that died in the middle of a write
+                   and is skipped.
+
+******************************************************************************/
+
+#define _GNU_SOURCE	// sched_getcpu()
+#include <sched.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "tttlog.h"
+
+#define LG_CACHE_LINE	64
+#define LG_BATCH	2048	// records per write()
+#define LG_STUCK_PASSES	50
+
+struct lg_ring {
+	_Alignas(LG_CACHE_LINE) uint32_t head;	// next slot reserved, by the writers
+	_Alignas(LG_CACHE_LINE) uint32_t tail;	// next slot read, by the flusher
+	_Alignas(LG_CACHE_LINE) struct lg_record record[LG_RING_RECORDS];
+};
+
+struct lg_shared {
+	_Alignas(LG_CACHE_LINE) uint32_t next_session;
+	uint32_t dropped;
+	int nrings;
+	struct lg_ring ring[];
+};
+
+struct lg_shared* lg_shared;
+
+static char _path[PATH_MAX];
+static long _rotate;
+static int _fd = -1;
+static long _size;			// of the current file
+static int _regular;			// only a regular file is rotated
+static pid_t _flusher_pid;		// process of the flusher thread
+static int _draining;			// taken by drain()
+static struct lg_record _batch[LG_BATCH];
+static uint32_t _stuck_at[LG_MAX_RINGS];	// tail that did not move
+static int _stuck[LG_MAX_RINGS];		// for that many passes
+
+static uint64_t realtime_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*****************************************************************************/
+/*                                 Writers                                   */
+/*****************************************************************************/
+
+uint32_t lg_new_session(void)
+{
+	return __atomic_add_fetch(&lg_shared->next_session, 1, __ATOMIC_RELAXED);
+}
+
+void lg_append(struct lg_record* r)
+{
+	struct lg_ring* ring;
+	struct lg_record* slot;
+	uint32_t head;
+	int cpu = sched_getcpu();
+
+	r->ns = realtime_ns();
+	ring = &lg_shared->ring[cpu < 0 ? 0 : cpu % lg_shared->nrings];
+	head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+	do {
+		if (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) >= LG_RING_RECORDS) {
+			__atomic_add_fetch(&lg_shared->dropped, 1, __ATOMIC_RELAXED);
+			return;
+		}
+	} while (!__atomic_compare_exchange_n(&ring->head, &head, head + 1, 1,
+					      __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+	slot = &ring->record[head & (LG_RING_RECORDS - 1)];
+	memcpy(slot, r, offsetof(struct lg_record, seq));
+	__atomic_store_n(&slot->seq, head + 1, __ATOMIC_RELEASE);
+}
+
+/*****************************************************************************/
+/*                                 Flusher                                   */
+/*****************************************************************************/
+
+//opens the log for appending; a new file gets its header
+static int open_log(void)
+{
+	struct lg_header h;
+	struct stat st;
+
+	if ((_fd = open(_path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644)) == -1)
+		return -1;
+	if (fstat(_fd, &st) == -1) {
+		close(_fd);
+		_fd = -1;
+		return -1;
+	}
+	_size = st.st_size;
+	_regular = S_ISREG(st.st_mode);
+	if (_size == 0 && _regular) {
+		memset(&h, 0, sizeof(h));
+		strcpy(h.magic, LG_MAGIC);
+		h.record_bytes = sizeof(struct lg_record);
+		h.pid = getpid();
+		h.started_ns = realtime_ns();
+		if (write(_fd, &h, sizeof(h)) == sizeof(h))
+			_size = sizeof(h);
+	}
+	return 0;
+}
+
+static void rotate(void)
+{
+	char from[PATH_MAX + 8], to[PATH_MAX + 8];
+	int i;
+
+	close(_fd);
+	for (i = LG_KEEP - 1; i >= 1; i--) {
+		snprintf(from, sizeof(from), "%s.%d", _path, i);
+		snprintf(to, sizeof(to), "%s.%d", _path, i + 1);
+		rename(from, to);
+	}
+	snprintf(to, sizeof(to), "%s.1", _path);
+	rename(_path, to);
+	open_log();
+}
+
+static void write_batch(int n)
+{
+	const char* p = (const char*) _batch;
+	long len = n * (long) sizeof(struct lg_record);
+	ssize_t w;
+
+	if (n == 0)
+		return;
+	if (_fd != -1 && _regular && _size + len > _rotate)
+		rotate();
+	if (_fd == -1 && open_log() == -1)
+		return;		// the batch is lost, the next one tries again
+	while (len > 0) {
+		if ((w = write(_fd, p, len)) == -1) {
+			if (errno == EINTR)
+				continue;
+			return;
+		}
+		p += w;
+		len -= w;
+		_size += w;
+	}
+}
+
+//moves every published record to the file
+static void drain(void)
+{
+	struct lg_ring* ring;
+	struct lg_record* r;
+	uint32_t t, h, dropped;
+	int i, n = 0;
+
+	while (__atomic_exchange_n(&_draining, 1, __ATOMIC_ACQUIRE))
+		sched_yield();
+	for (i = 0; i < lg_shared->nrings; i++) {
+		ring = &lg_shared->ring[i];
+		t = ring->tail;
+		h = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+		while (t != h) {
+			r = &ring->record[t & (LG_RING_RECORDS - 1)];
+			if (__atomic_load_n(&r->seq, __ATOMIC_ACQUIRE) != t + 1) {
+				if (t != _stuck_at[i]) {
+					_stuck_at[i] = t;
+					_stuck[i] = 0;
+				}
+				if (++_stuck[i] < LG_STUCK_PASSES)
+					break;
+				__atomic_add_fetch(&lg_shared->dropped, 1, __ATOMIC_RELAXED);
+				t++;	// its writer is gone
+				continue;
+			}
+			_batch[n++] = *r;
+			t++;
+			if (n == LG_BATCH) {
+				__atomic_store_n(&ring->tail, t, __ATOMIC_RELEASE);
+				write_batch(n);
+				n = 0;
+			}
+		}
+		__atomic_store_n(&ring->tail, t, __ATOMIC_RELEASE);
+	}
+	if ((dropped = __atomic_exchange_n(&lg_shared->dropped, 0, __ATOMIC_RELAXED)) > 0) {
+		if (n == LG_BATCH) {
+			write_batch(n);
+			n = 0;
+		}
+		memset(&_batch[n], 0, sizeof(_batch[n]));
+		_batch[n].ns = realtime_ns();
+		_batch[n].type = LG_DROPPED;
+		_batch[n++].value = dropped;
+	}
+	write_batch(n);
+	__atomic_store_n(&_draining, 0, __ATOMIC_RELEASE);
+}
+
+static void* flusher(void* arg)
+{
+	struct timespec pause = { 0, LG_FLUSH_MS * 1000000L };
+
+	for (;;) {
+		nanosleep(&pause, NULL);
+		drain();
+	}
+	return NULL;
+}
+
+int lg_init(const char* path, long rotate_bytes)
+{
+	long cpus = sysconf(_SC_NPROCESSORS_CONF);
+	int fd, nrings;
+	void* p;
+
+	if (path[0] == '/')
+		snprintf(_path, sizeof(_path), "%s", path);
+	else if (getcwd(_path, sizeof(_path)) == NULL ||
+		 strlen(_path) + strlen(path) + 2 > sizeof(_path)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	else
+		strcat(strcat(_path, "/"), path);
+	if ((fd = open(_path, O_WRONLY | O_CREAT | O_APPEND, 0644)) == -1)
+		return -1;
+	close(fd);
+	_rotate = rotate_bytes;
+
+	nrings = cpus < 1 ? 1 : cpus > LG_MAX_RINGS ? LG_MAX_RINGS : cpus;
+	// zero filled; the rings of CPUs that never log are never touched
+	p = mmap(NULL, sizeof(struct lg_shared) + nrings * sizeof(struct lg_ring),
+		 PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED)
+		return -1;
+	lg_shared = p;
+	lg_shared->nrings = nrings;
+	return 0;
+}
+
+int lg_start(void)
+{
+	pthread_t tid;
+	sigset_t all, old;
+	int err;
+
+	if (open_log() == -1)
+		return -1;
+	// signals go to the other threads, see lg_stop()
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	err = pthread_create(&tid, NULL, flusher, NULL);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	if (err != 0) {
+		errno = err;
+		return -1;
+	}
+	pthread_detach(tid);
+	_flusher_pid = getpid();
+	return 0;
+}
+
+void lg_stop(void)
+{
+	if (lg_shared != NULL && _flusher_pid == getpid())
+		drain();
+}
@@ -0,0 +1,93 @@
+/******************************************************************************
+  Title          : tttlog.h
+  Author         : Andriy Goltsev
+  Description    : Binary event log of the server
+
+  Notes          : Every session start and end, every move and every game
+                   result becomes one fixed-size struct lg_record. A writer
+                   never touches the disk: it reserves a slot in the ring
+                   of the CPU it runs on with one compare-and-swap, fills it
+                   in and publishes it by storing its sequence number. The
+                   rings are in memory mapped by lg_init() before the server
+                   forks, so the children write into them too. A flusher
+                   thread of the server (lg_start()) drains all rings every
+                   LG_FLUSH_MS into one write() and starts a new file when
+                   the current one would grow past the rotation size: the
+                   log moves to log.1, log.1 to log.2 and so on up to
+                   log.LG_KEEP.
+
+                   A record that finds its ring full is dropped and
+                   counted; the flusher writes an LG_DROPPED record with the
+                   count. Records of different CPUs are written in the order
+                   the rings are drained, so readers sort by ns when the
+                   order matters (tttlogcat -s). A file starts with a
+                   struct lg_header.
+
+******************************************************************************/
+
+#ifndef TTTLOG_H
+#define TTTLOG_H
+
+#include <stdint.h>
+
+#define LG_MAGIC	"TTTLOG1"
+#define LG_RING_RECORDS	16384		// per CPU, a power of 2
+#define LG_MAX_RINGS	64		// CPUs above share the rings
+#define LG_FLUSH_MS	20
+#define LG_ROTATE_BYTES	(64L << 20)	// default size of a file
+#define LG_KEEP		4		// rotated files kept
+
+enum lg_type {
+	LG_SESSION_START = 1,	// rows, cols, k, level, engine and transport
+	LG_SESSION_END,		// value: games started in the session
+	LG_MOVE,		// a client move and the reply
+	LG_GAME_END,		// status: the result, value: moves of the game
+	LG_DROPPED		// value: records lost since the last one
+};
+
+struct lg_record {
+	uint64_t ns;		// CLOCK_REALTIME
+	uint32_t session;	// unique while the server runs
+	uint16_t game;		// id within the session
+	uint8_t type;		// enum lg_type
+	int8_t status;		// of the reply, see ttt.h
+	uint8_t row, col;	// client's move; rows and cols of a session start
+	uint8_t server_row, server_col;	// reply; k and level of a session start
+	uint32_t spent_ns;	// think time of a move, handshake time of a session
+	uint32_t value;		// see enum lg_type; engine | transport << 8 at a start
+	uint32_t seq;		// position in its ring + 1, written last
+};
+
+struct lg_header {
+	char magic[8];		// LG_MAGIC
+	uint32_t record_bytes;	// sizeof(struct lg_record)
+	uint32_t pid;		// of the server
+	uint64_t started_ns;	// CLOCK_REALTIME when the file was started
+	uint64_t unused;
+};
+
+extern struct lg_shared* lg_shared;	// NULL while the log is off
+
+//maps the rings and checks that path can be written; rotate_bytes is the
+//largest size of a file. Returns -1 with errno set
+int lg_init(const char* path, long rotate_bytes);
+
+//starts the flusher thread; after daemon_init(), which closes every file
+int lg_start(void);
+
+//writes what is left in the rings; safe in a signal handler of a thread
+//other than the flusher
+void lg_stop(void);
+
+static inline int lg_on(void)
+{
+	return lg_shared != NULL;
+}
+
+//a number for a new session
+uint32_t lg_new_session(void);
+
+//stamps r with the time and appends it to the ring of this CPU
+void lg_append(struct lg_record* r);
+
+#endif
@@ -0,0 +1,144 @@
+/******************************************************************************
+  Title          : tttlogcat.c
+  Author         : Andriy Goltsev
+  Description    : Prints the binary event log of tttserver
+
+  Build with     : make tttlogcat
+
+  Usage          : tttlogcat [-s] logfile...
+                   Prints every record of the files (see tttlog.h) as one
+                   line of text: the time, the session and game, and what
+                   happened. With -s the records of all files are sorted by
+                   time first; otherwise they come in the order the
+                   server's flusher wrote them, which is by CPU within each
+                   flush.
+
+******************************************************************************/
+
+#include <time.h>
+#include "ttt.h"
+#include "tttlog.h"
+
+static const char* _results[] = { "in play", "tie", "client wins", "server wins" };
+
+static struct lg_record* _records;
+static long _n, _size;
+
+//appends the records of path; returns -1 if it is not a log
+static int load(const char* path)
+{
+	struct lg_header h;
+	FILE* f;
+	size_t got;
+
+	if ((f = fopen(path, "r")) == NULL) {
+		perror(path);
+		return -1;
+	}
+	if (fread(&h, sizeof(h), 1, f) != 1 || strcmp(h.magic, LG_MAGIC) != 0 ||
+	    h.record_bytes != sizeof(struct lg_record)) {
+		fprintf(stderr, "%s: not an event log\n", path);
+		fclose(f);
+		return -1;
+	}
+	for (;;) {
+		if (_n == _size) {
+			_size = _size ? 2 * _size : 4096;
+			if ((_records = realloc(_records, _size * sizeof(*_records))) == NULL) {
+				perror("realloc");
+				exit(1);
+			}
+		}
+		if ((got = fread(_records + _n, sizeof(*_records), _size - _n, f)) == 0)
+			break;
+		_n += got;
+	}
+	fclose(f);
+	return 0;
+}
+
+static int by_time(const void* a, const void* b)
+{
+	const struct lg_record* x = a;
+	const struct lg_record* y = b;
+
+	return x->ns < y->ns ? -1 : x->ns > y->ns;
+}
+
+static void print(const struct lg_record* r)
+{
+	char stamp[32];
+	time_t sec = r->ns / 1000000000ULL;
+	struct tm tm;
+
+	localtime_r(&sec, &tm);
+	strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &tm);
+	printf("%s.%09llu ", stamp, (unsigned long long) (r->ns % 1000000000ULL));
+	switch (r->type) {
+		case LG_SESSION_START:
+			printf("session %u start %dx%d k=%d level %d %s %s%s handshake %u us\n",
+			       r->session, r->row, r->col, r->server_row, r->server_col,
+			       (r->value & 0xff) == ENGINE_MCTS ? "mcts" : "search",
+			       (r->value >> 8) == TRANSPORT_RING ? "ring" : "stream",
+			       r->status == INVALID_BOARD ? " invalid-board" : "", r->spent_ns / 1000);
+			break;
+		case LG_SESSION_END:
+			printf("session %u end after %u games\n", r->session, r->value);
+			break;
+		case LG_MOVE:
+			printf("session %u game %u move %d,%d -> ", r->session, r->game,
+			       (int8_t) r->row, (int8_t) r->col);
+			if (r->status == INVALID_MOVE)
+				printf("invalid move\n");
+			else if (r->status == INVALID_BOARD)
+				printf("invalid board\n");
+			else
+				printf("%d,%d %s think %u ns\n", r->server_row, r->server_col,
+				       r->status >= 0 && r->status <= SERVER_WINS ? _results[r->status] : "?",
+				       r->spent_ns);
+			break;
+		case LG_GAME_END:
+			printf("session %u game %u %s after %u moves\n", r->session, r->game,
+			       r->status >= 0 && r->status <= SERVER_WINS ? _results[r->status] : "?",
+			       r->value);
+			break;
+		case LG_DROPPED:
+			printf("%u records dropped\n", r->value);
+			break;
+		default:
+			printf("unknown record type %d\n", r->type);
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	int opt, sorted = 0, failed = 0;
+	long i;
+
+	while ((opt = getopt(argc, argv, "s")) != -1) {
+		switch (opt) {
+			case 's': sorted = 1; break;
+			default:
+				fprintf(stderr, "usage: %s [-s] logfile...\n", argv[0]);
+				exit(1);
+		}
+	}
+	if (optind == argc) {
+		fprintf(stderr, "usage: %s [-s] logfile...\n", argv[0]);
+		exit(1);
+	}
+	for (; optind < argc; optind++) {
+		failed |= load(argv[optind]) == -1;
+		if (!sorted) {
+			for (i = 0; i < _n; i++)
+				print(&_records[i]);
+			_n = 0;
+		}
+	}
+	if (sorted) {
+		qsort(_records, _n, sizeof(*_records), by_time);
+		for (i = 0; i < _n; i++)
+			print(&_records[i]);
+	}
+	return failed;
+}
@@ -0,0 +1,318 @@
+/******************************************************************************
+  Title          : tttmcts.c
+  Author         : Andriy Goltsev
+  Description    : UCT search with random bitboard playouts
+
+  Notes          : A node stores the visits and wins of the side that played
+                   its move. Children are the empty cells next to a piece
+                   (tg_frontier()) and are allocated together, as one array,
+                   the second time a leaf is reached. Playouts fill the
+                   board with random moves drawn from the list of empty
+                   cells; every move is checked for a win through the O(k)
+                   test of the grid.
+
+******************************************************************************/
+
+#include <math.h>
+#include <time.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "tttmcts.h"
+
+#define TM_EXPLORE	1.4f	// UCT exploration constant
+#define TM_MAX_DEPTH	TG_MAX_CELLS
+
+struct tm_node {
+	struct tm_node* children;
+	int nchildren;		// -1 until the node is expanded
+	int cell;		// move that led to this node
+	unsigned visits;
+	float wins;		// of the side that played cell, a tie counts 1/2
+};
+
+static size_t _arena_limit = TM_ARENA_BYTES;
+
+static long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+//xorshift64*
+static uint64_t next_random(uint64_t* state)
+{
+	*state ^= *state >> 12;
+	*state ^= *state << 25;
+	*state ^= *state >> 27;
+	return *state * 0x2545f4914f6cdd1dULL;
+}
+
+/*****************************************************************************/
+/*                                 Arena                                     */
+/*****************************************************************************/
+
+//returns n bytes from the arena, or NULL once it is full
+static void* arena_alloc(struct tm_arena* a, size_t n)
+{
+	void* p;
+
+	if (a->base == NULL) {
+		p = mmap(NULL, _arena_limit, PROT_READ | PROT_WRITE,
+			 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		if (p == MAP_FAILED)
+			return NULL;
+		a->base = p;
+		a->size = _arena_limit;
+	}
+	n = (n + 15) & ~(size_t) 15;
+	if (a->used + n > a->size)
+		return NULL;
+	p = a->base + a->used;
+	a->used += n;
+	if (a->used > a->peak)
+		a->peak = a->used;
+	if (a->used > a->high)
+		a->high = a->used;
+	return p;
+}
+
+static void arena_reset(struct tm_arena* a)
+{
+	if (a->base != NULL && a->used > 0)
+		madvise(a->base, a->used, MADV_DONTNEED);
+	a->used = 0;
+}
+
+/*****************************************************************************/
+/*                                 Tree                                      */
+/*****************************************************************************/
+
+static struct tm_node* new_root(struct tm_tree* t)
+{
+	struct tm_node* n = arena_alloc(&t->arena, sizeof(struct tm_node));
+
+	if (n != NULL) {
+		n->children = NULL;
+		n->nchildren = -1;
+		n->cell = TB_NO_CELL;
+		n->visits = 0;
+		n->wins = 0;
+	}
+	return n;
+}
+
+//gives node one child per candidate cell of g; returns 0 if out of memory
+static int expand(struct tm_tree* t, struct tm_node* node, const struct ttt_grid* g)
+{
+	tg_bits cells;
+	uint64_t free;
+	int w, n = 0;
+
+	tg_frontier(g, &cells);
+	if (g->moves == 0)
+		cells = g->all;
+	for (w = 0; w < TG_WORDS; w++)
+		n += __builtin_popcountll(cells.w[w]);
+	if ((node->children = arena_alloc(&t->arena, n * sizeof(struct tm_node))) == NULL)
+		return 0;
+	node->nchildren = 0;
+	for (w = 0; w < TG_WORDS; w++) {
+		for (free = cells.w[w]; free; free &= free - 1) {
+			struct tm_node* c = &node->children[node->nchildren++];
+
+			c->children = NULL;
+			c->nchildren = -1;
+			c->cell = (w << 6) + __builtin_ctzll(free);
+			c->visits = 0;
+			c->wins = 0;
+		}
+	}
+	return 1;
+}
+
+//the child of node with the best upper confidence bound
+static struct tm_node* select_child(struct tm_node* node)
+{
+	struct tm_node* best = NULL;
+	float score, best_score = -1.0f;
+	float log_visits = logf((float) node->visits + 1.0f);
+	int i;
+
+	for (i = 0; i < node->nchildren; i++) {
+		struct tm_node* c = &node->children[i];
+
+		if (c->visits == 0)
+			return c;
+		score = c->wins / c->visits + TM_EXPLORE * sqrtf(log_visits / c->visits);
+		if (score > best_score) {
+			best_score = score;
+			best = c;
+		}
+	}
+	return best;
+}
+
+//plays random moves from g with side to move; returns the winner or TG_NONE
+static int playout(struct tm_tree* t, struct ttt_grid* g, int side)
+{
+	int empty[TG_MAX_CELLS];
+	int n = 0, w, i;
+	uint64_t free;
+
+	for (w = 0; w < TG_WORDS; w++)
+		for (free = g->all.w[w] & ~g->occupied.w[w]; free; free &= free - 1)
+			empty[n++] = (w << 6) + __builtin_ctzll(free);
+
+	while (n > 0 && g->winner == TG_NONE) {
+		i = next_random(&t->rng) % n;
+		tg_apply(g, side, empty[i]);
+		empty[i] = empty[--n];
+		side = !side;
+	}
+	return g->winner;
+}
+
+//one selection, expansion, playout and backup from the root
+static void iterate(struct tm_tree* t, int side)
+{
+	struct tm_node* path[TM_MAX_DEPTH + 1];
+	int mover[TM_MAX_DEPTH + 1];	// side that played path[i]->cell
+	struct ttt_grid g = t->grid;
+	struct tm_node* node = t->root;
+	int depth = 0, winner, i;
+
+	path[depth] = node;
+	mover[depth++] = !side;
+	while (g.winner == TG_NONE && !tg_is_full(&g)) {
+		if (node->nchildren < 0) {
+			if (node->visits == 0 && node != t->root)
+				break;	// expand on the second visit
+			if (!expand(t, node, &g))
+				break;	// arena full, the tree stops growing
+		}
+		if (node->nchildren == 0 || (node = select_child(node)) == NULL)
+			break;
+		tg_apply(&g, side, node->cell);
+		path[depth] = node;
+		mover[depth++] = side;
+		side = !side;
+	}
+
+	winner = playout(t, &g, side);
+	for (i = 0; i < depth; i++) {
+		path[i]->visits++;
+		if (winner == mover[i])
+			path[i]->wins += 1.0f;
+		else if (winner == TG_NONE)
+			path[i]->wins += 0.5f;
+	}
+}
+
+//moves the root down to the current position when the tree has it
+static void follow(struct tm_tree* t, const struct ttt_grid* g, int side)
+{
+	struct tm_node* c = NULL;
+	int cell, w, i, added = 0;
+
+	if (t->root == NULL || t->grid.rows != g->rows || t->grid.cols != g->cols ||
+	    t->grid.k != g->k || g->moves != t->grid.moves + 1)
+		goto fresh;
+	// past half the arena, a new tree is worth more than the old subtree
+	if (t->arena.used > t->arena.size / 2)
+		goto fresh;
+	for (w = 0; w < TG_WORDS; w++) {
+		if (g->side[side].w[w] != t->grid.side[side].w[w] ||
+		    (t->grid.side[!side].w[w] & ~g->side[!side].w[w]))
+			goto fresh;
+		added += __builtin_popcountll(g->side[!side].w[w] & ~t->grid.side[!side].w[w]);
+	}
+	if (added != 1)
+		goto fresh;
+	for (i = 0; i < t->root->nchildren; i++) {
+		cell = t->root->children[i].cell;
+		if (tg_test(&g->side[!side], cell) && !tg_test(&t->grid.side[!side], cell)) {
+			c = &t->root->children[i];
+			break;
+		}
+	}
+	if (c == NULL)
+		goto fresh;
+	t->root = c;
+	t->grid = *g;
+	return;
+
+fresh:
+	arena_reset(&t->arena);
+	t->grid = *g;
+	t->root = new_root(t);
+}
+
+void tm_init(struct tm_tree* t)
+{
+	memset(t, 0, sizeof(*t));
+	t->rng = 0x9e3779b97f4a7c15ULL;
+}
+
+int tm_best_move(struct tm_tree* t, const struct ttt_grid* g, int side, long budget_ms)
+{
+	struct tm_node* best = NULL;
+	long long deadline = now_ns() + budget_ms * 1000000LL;
+	int i, cell;
+
+	if (tg_is_full(g))
+		return TB_NO_CELL;
+	// a win in one needs no search
+	for (cell = tg_next_empty(g, 0); cell != TB_NO_CELL; cell = tg_next_empty(g, cell + 1))
+		if (tg_makes_line(g, side, cell))
+			return cell;
+
+	follow(t, g, side);
+	if (t->root == NULL)
+		return tg_next_empty(g, 0);	// no memory at all
+
+	t->playouts = 0;
+	do {
+		for (i = 0; i < 64; i++)
+			iterate(t, side);
+		t->playouts += 64;
+	} while (now_ns() < deadline);
+
+	for (i = 0; i < t->root->nchildren; i++)
+		if (best == NULL || t->root->children[i].visits > best->visits)
+			best = &t->root->children[i];
+	if (best == NULL)
+		return tg_next_empty(g, 0);
+
+	// keep the subtree of the move played for the next call
+	t->root = best;
+	tg_apply(&t->grid, side, best->cell);
+	return best->cell;
+}
+
+void tm_reset(struct tm_tree* t)
+{
+	arena_reset(&t->arena);
+	t->arena.peak = 0;
+	t->root = NULL;
+}
+
+void tm_release(struct tm_tree* t)
+{
+	if (t->arena.base != NULL)
+		munmap(t->arena.base, t->arena.size);
+	t->arena.base = NULL;
+	t->arena.size = t->arena.used = 0;
+	t->root = NULL;
+}
+
+void tm_set_arena_limit(size_t bytes)
+{
+	_arena_limit = bytes;
+}
+
+size_t tm_arena_limit(void)
+{
+	return _arena_limit;
+}
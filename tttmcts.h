@@ -0,0 +1,63 @@
+/******************************************************************************
+  Title          : tttmcts.h
+  Author         : Andriy Goltsev
+  Description    : Monte Carlo tree search (UCT) engine
+
+  Notes          : An alternative to tttdeep.h for big boards, chosen per
+                   game in the handshake. Each game owns a struct tm_tree.
+                   Its nodes come from an arena of at most TM_ARENA_BYTES
+                   (tm_set_arena_limit()); when the arena is full the tree
+                   stops growing and the time left goes to playouts from
+                   the existing leaves. The subtree under the moves actually
+                   played is kept from one server move to the next, and
+                   tm_reset() drops the whole tree in one step when the game
+                   is over.
+
+******************************************************************************/
+
+#ifndef TTTMCTS_H
+#define TTTMCTS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "tttgrid.h"
+
+#define TM_ARENA_BYTES	(16 << 20)	// default cap of one game's tree
+
+struct tm_node;
+
+struct tm_arena {
+	char* base;		// reserved with mmap on first use
+	size_t size;		// capacity
+	size_t used;
+	size_t peak;		// largest used since the last tm_reset()
+	size_t high;		// largest used since tm_init(), kept by tm_reset()
+};
+
+struct tm_tree {
+	struct tm_arena arena;
+	struct tm_node* root;	// node of the position in grid, or NULL
+	struct ttt_grid grid;	// position at the root
+	uint64_t rng;
+	long playouts;		// playouts of the last tm_best_move()
+};
+
+//prepares an empty tree; nothing is allocated until the first search
+void tm_init(struct tm_tree* t);
+
+//returns the cell side should play on g within budget_ms, or TB_NO_CELL
+int tm_best_move(struct tm_tree* t, const struct ttt_grid* g, int side, long budget_ms);
+
+//forgets the tree (new game); the arena's pages go back to the system
+void tm_reset(struct tm_tree* t);
+
+//unmaps the arena
+void tm_release(struct tm_tree* t);
+
+//sets the arena capacity of trees that have not allocated yet
+void tm_set_arena_limit(size_t bytes);
+
+//returns the arena capacity of new trees
+size_t tm_arena_limit(void);
+
+#endif
@@ -0,0 +1,927 @@
+/******************************************************************************
+  Title          : tttperf.c
+  Author         : Andriy Goltsev
+  Description    : Microbenchmark of the per-move engine functions
+
+  Build with     : make tttperf
+
+  Usage          : tttperf [-r positions] [-a positions] [-g games]
+                           [-p positions] [-m ms] [-b bookfile] [-s seed]
+                           [-L logfile]
+                   Builds three corpora of positions: every position of the
+                   classic board reachable from the empty board, -r random
+                   positions (200 by default) and -a adversarial ones (50)
+                   per geometry, the latter filled to within a few cells of
+                   a tie without a line. Each corpus goes through
+                   ttt_status(), validMove() (every cell and the four
+                   borders) and counterAttack() at level 0; the classic
+                   positions also at perfect play and at most -p positions
+                   (500) of the others at level 2. -g random games (200)
+                   per geometry are replayed through ttt_play(). The
+                   positions of each corpus are also packed into one batch
+                   per geometry (tttbatch.h) and go through bt_eval() with
+                   every kernel the machine runs; its status must be the
+                   reference's and its legal moves the empty cells.
+
+                   Every function is timed over whole passes of its corpus
+                   for at least -m milliseconds (100) and reports ns/op and
+                   the allocations (malloc, calloc, realloc and mmap made by
+                   the engine) per op. Before timing, the results of one
+                   pass are checked against the reference implementation
+                   below, a char matrix scanned the way the first server
+                   did it. A level 0 server must answer exactly as the
+                   reference, a perfect one must keep the minimax value of
+                   the position and a level 2 one must take a win in one.
+                   tttperf exits with 1 if any result differs.
+                   -L turns the event log of tttlog.h on, written to
+                   logfile, to measure what it adds to a move.
+
+  Notes          : counterAttack() changes the board, so its time includes
+                   the tg_undo() that restores the position.
+
+******************************************************************************/
+
+#include <time.h>
+#include <sys/mman.h>
+#include "ttt.h"
+#include "tttgame.h"
+#include "tttgeom.h"
+#include "tttbook.h"
+#include "tttsearch.h"
+#include "tttlog.h"
+#include "tttbatch.h"
+
+// the classic board as numbers in base 3
+#define PERF_CLASSIC_POSITIONS	19683
+
+struct ref_game {
+	int rows, cols, k;
+	char board[MAX_BOARD_SIZE][MAX_BOARD_SIZE];
+	char server_char, client_char;
+};
+
+struct perf_pos {
+	struct ttt_game game;	// the position for the engine
+	struct ref_game ref;	// and for the reference
+	int status;		// ref_status()
+	int first;		// ref_first_empty()
+	int win;		// the server has a win in one
+};
+
+struct perf_script {
+	struct handshake hndshk;
+	struct move* client;	// n moves of the client, some of them invalid
+	struct move* reply;	// answers of the reference
+	int n;
+};
+
+// the positions of a corpus on one geometry, packed for bt_eval()
+struct perf_batch {
+	struct bt_batch boards;
+	int* pos;		// index in the corpus of each board
+	signed char* status;
+	uint64_t* legal;
+};
+
+struct perf_corpus {
+	const char* name;
+	struct perf_pos* pos;
+	int n, size;
+	struct perf_script* script;
+	int nscripts;
+	int search_level;	// counterAttack() level checked on this corpus
+	struct perf_batch* batch;	// by geometry
+};
+
+typedef long (*perf_pass)(struct perf_corpus* c, int* out);
+typedef long (*perf_check)(struct perf_corpus* c, const int* out);
+
+static const struct {
+	int rows, cols, k;
+} _geometries[] = {
+#define PERF_GEOMETRY(R, C, K)	{ R, C, K },
+	TG_WORD_GEOMETRIES(PERF_GEOMETRY)
+	TG_WIDE_GEOMETRIES(PERF_GEOMETRY)
+	{ 9, 9, 5 },		// no specialized engine
+	{ 6, 12, 4 },
+};
+#define PERF_GEOMETRIES	(int) (sizeof(_geometries) / sizeof(_geometries[0]))
+
+static int _random = 200, _adversarial = 50, _games = 200, _searched = 500;
+static long long _min_ns = 100000000LL;
+static uint64_t _rng = 1;
+static int* _out;		// results of one pass
+static long _allocs;		// counted by the wrappers below
+
+static long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+//xorshift64*
+static uint64_t next_random(uint64_t* state)
+{
+	*state ^= *state >> 12;
+	*state ^= *state << 25;
+	*state ^= *state >> 27;
+	return *state * 0x2545f4914f6cdd1dULL;
+}
+
+/*****************************************************************************/
+/*                     Allocation counters (ld --wrap)                       */
+/*****************************************************************************/
+
+void* __real_malloc(size_t n);
+void* __real_calloc(size_t n, size_t size);
+void* __real_realloc(void* p, size_t n);
+void* __real_mmap(void* addr, size_t n, int prot, int flags, int fd, off_t off);
+
+void* __wrap_malloc(size_t n)
+{
+	__atomic_add_fetch(&_allocs, 1, __ATOMIC_RELAXED);
+	return __real_malloc(n);
+}
+
+void* __wrap_calloc(size_t n, size_t size)
+{
+	__atomic_add_fetch(&_allocs, 1, __ATOMIC_RELAXED);
+	return __real_calloc(n, size);
+}
+
+void* __wrap_realloc(void* p, size_t n)
+{
+	__atomic_add_fetch(&_allocs, 1, __ATOMIC_RELAXED);
+	return __real_realloc(p, n);
+}
+
+void* __wrap_mmap(void* addr, size_t n, int prot, int flags, int fd, off_t off)
+{
+	__atomic_add_fetch(&_allocs, 1, __ATOMIC_RELAXED);
+	return __real_mmap(addr, n, prot, flags, fd, off);
+}
+
+/*****************************************************************************/
+/*                       Reference implementation                            */
+/*****************************************************************************/
+
+static void ref_init(struct ref_game* g, const struct handshake* hndshk)
+{
+	g->rows = hndshk->rows;
+	g->cols = hndshk->cols;
+	g->k = hndshk->win_len;
+	g->server_char = hndshk->server_char;
+	g->client_char = hndshk->client_char;
+	memset(g->board, EMPTY_CELL, sizeof(g->board));
+}
+
+static int ref_inside(const struct ref_game* g, int r, int c)
+{
+	return 0 <= r && r < g->rows && 0 <= c && c < g->cols;
+}
+
+//returns 1 if k pieces ch are in a row anywhere on the board
+static int ref_line(const struct ref_game* g, char ch)
+{
+	static const int dr[4] = { 0, 1, 1, 1 };
+	static const int dc[4] = { 1, 0, 1, -1 };
+	int r, c, d, n;
+
+	for (r = 0; r < g->rows; r++)
+		for (c = 0; c < g->cols; c++)
+			for (d = 0; d < 4; d++) {
+				for (n = 0; n < g->k && ref_inside(g, r + n * dr[d], c + n * dc[d]) &&
+					    g->board[r + n * dr[d]][c + n * dc[d]] == ch; n++)
+					;
+				if (n == g->k)
+					return 1;
+			}
+	return 0;
+}
+
+//returns 1 if ch on the empty cell (r, c) would complete a line
+static int ref_makes_line(const struct ref_game* g, char ch, int r, int c)
+{
+	static const int dr[4] = { 0, 1, 1, 1 };
+	static const int dc[4] = { 1, 0, 1, -1 };
+	int d, n, i;
+
+	for (d = 0; d < 4; d++) {
+		n = 1;
+		for (i = 1; ref_inside(g, r + i * dr[d], c + i * dc[d]) &&
+			    g->board[r + i * dr[d]][c + i * dc[d]] == ch; i++)
+			n++;
+		for (i = 1; ref_inside(g, r - i * dr[d], c - i * dc[d]) &&
+			    g->board[r - i * dr[d]][c - i * dc[d]] == ch; i++)
+			n++;
+		if (n >= g->k)
+			return 1;
+	}
+	return 0;
+}
+
+static int ref_status(const struct ref_game* g)
+{
+	int r, c;
+
+	if (ref_line(g, g->server_char))
+		return SERVER_WINS;
+	if (ref_line(g, g->client_char))
+		return CLIENT_WINS;
+	for (r = 0; r < g->rows; r++)
+		for (c = 0; c < g->cols; c++)
+			if (g->board[r][c] == EMPTY_CELL)
+				return STATUS_OK;
+	return TIED;
+}
+
+static int ref_valid(const struct ref_game* g, const struct move* mv)
+{
+	if (ref_inside(g, mv->row, mv->col) && g->board[mv->row][mv->col] == EMPTY_CELL)
+		return STATUS_OK;
+	return INVALID_MOVE;
+}
+
+//the first empty cell in row-major order, or TB_NO_CELL
+static int ref_first_empty(const struct ref_game* g)
+{
+	int r, c;
+
+	for (r = 0; r < g->rows; r++)
+		for (c = 0; c < g->cols; c++)
+			if (g->board[r][c] == EMPTY_CELL)
+				return r * g->cols + c;
+	return TB_NO_CELL;
+}
+
+//ttt_play() of a level 0 server
+static void ref_play(struct ref_game* g, const struct move* client_mv, struct move* server_mv)
+{
+	int cell;
+
+	server_mv->row = server_mv->col = 0;
+	if ((server_mv->status = ref_valid(g, client_mv)) != STATUS_OK)
+		return;
+	g->board[client_mv->row][client_mv->col] = g->client_char;
+	if ((server_mv->status = ref_status(g)) == STATUS_OK) {
+		cell = ref_first_empty(g);
+		g->board[cell / g->cols][cell % g->cols] = g->server_char;
+		server_mv->row = cell / g->cols;
+		server_mv->col = cell % g->cols;
+		server_mv->status = ref_status(g);
+	}
+	if (server_mv->status != STATUS_OK)
+		memset(g->board, EMPTY_CELL, sizeof(g->board));
+}
+
+//index of the classic board in base 3
+static int ref_index(const struct ref_game* g)
+{
+	int r, c, index = 0;
+
+	for (r = 0; r < 3; r++)
+		for (c = 0; c < 3; c++)
+			index = index * 3 + (g->board[r][c] == g->server_char ? 1 :
+					     g->board[r][c] == g->client_char ? 2 : 0);
+	return index;
+}
+
+//plain minimax of the classic board: 1 if me wins, 0 for a tie, -1 if me loses
+static int ref_value(struct ref_game* g, char me, char them)
+{
+	static signed char memo[2][PERF_CLASSIC_POSITIONS];
+	signed char* value = &memo[me == g->client_char][ref_index(g)];
+	int r, c, v, best = -1;
+
+	if (*value)
+		return *value - 2;
+	if (ref_line(g, them))
+		best = -1;
+	else if (ref_first_empty(g) == TB_NO_CELL)
+		best = 0;
+	else
+		for (r = 0; r < 3; r++)
+			for (c = 0; c < 3; c++)
+				if (g->board[r][c] == EMPTY_CELL) {
+					g->board[r][c] = me;
+					v = -ref_value(g, them, me);
+					g->board[r][c] = EMPTY_CELL;
+					if (v > best)
+						best = v;
+				}
+	*value = best + 2;
+	return best;
+}
+
+/*****************************************************************************/
+/*                                Corpora                                    */
+/*****************************************************************************/
+
+static void handshake_for(struct handshake* hndshk, int geometry)
+{
+	memset(hndshk, 0, sizeof(*hndshk));
+	hndshk->version = TP_VERSION;
+	hndshk->client_char = X_CELL;
+	hndshk->server_char = O_CELL;
+	hndshk->level = TS_LEVEL_FIRST_EMPTY;
+	hndshk->rows = _geometries[geometry].rows;
+	hndshk->cols = _geometries[geometry].cols;
+	hndshk->win_len = _geometries[geometry].k;
+	hndshk->engine = ENGINE_SEARCH;
+}
+
+static void pos_start(struct perf_pos* p, int geometry)
+{
+	struct handshake hndshk;
+
+	handshake_for(&hndshk, geometry);
+	init_new_game(&p->game, &hndshk);
+	ref_init(&p->ref, &hndshk);
+}
+
+//puts a piece of side on cell of both boards
+static void pos_play(struct perf_pos* p, int side, int cell)
+{
+	tg_apply(&p->game.board, side, cell);
+	p->ref.board[cell / p->ref.cols][cell % p->ref.cols] =
+		side == TB_SERVER ? p->ref.server_char : p->ref.client_char;
+}
+
+static void pos_add(struct perf_corpus* c, const struct perf_pos* p)
+{
+	struct perf_pos* q;
+	int r, col;
+
+	if (c->n == c->size) {
+		c->size = c->size ? 2 * c->size : 1024;
+		if ((c->pos = realloc(c->pos, c->size * sizeof(*c->pos))) == NULL) {
+			perror("realloc");
+			exit(1);
+		}
+	}
+	q = &c->pos[c->n++];
+	*q = *p;
+	q->status = ref_status(&q->ref);
+	q->first = ref_first_empty(&q->ref);
+	q->win = 0;
+	if (q->status == STATUS_OK)
+		for (r = 0; r < q->ref.rows; r++)
+			for (col = 0; col < q->ref.cols; col++)
+				if (q->ref.board[r][col] == EMPTY_CELL &&
+				    ref_makes_line(&q->ref, q->ref.server_char, r, col))
+					q->win = 1;
+}
+
+//every position of the classic board reachable with the client moving first
+static void enumerate(struct perf_corpus* c, struct perf_pos* p, int side, unsigned char* seen)
+{
+	int cell, index = ref_index(&p->ref);
+
+	if (seen[index])
+		return;
+	seen[index] = 1;
+	pos_add(c, p);
+	if (c->pos[c->n - 1].status != STATUS_OK)
+		return;
+	for (cell = 0; cell < 9; cell++)
+		if (p->ref.board[cell / 3][cell % 3] == EMPTY_CELL) {
+			pos_play(p, side, cell);
+			enumerate(c, p, !side, seen);
+			tg_undo(&p->game.board, side, cell);
+			p->ref.board[cell / 3][cell % 3] = EMPTY_CELL;
+		}
+}
+
+//random games stopped after a random number of moves or at the end
+static void random_positions(struct perf_corpus* c)
+{
+	struct perf_pos p;
+	int g, i, n, stop, side, cell, empty[TG_MAX_CELLS];
+
+	for (g = 0; g < PERF_GEOMETRIES; g++)
+		for (i = 0; i < _random; i++) {
+			pos_start(&p, g);
+			for (n = 0; n < p.game.board.cells; n++)
+				empty[n] = n;
+			stop = next_random(&_rng) % (n + 1);
+			for (side = TB_CLIENT; p.game.board.moves < stop &&
+				     p.game.board.winner == TG_NONE; side = !side) {
+				cell = next_random(&_rng) % n;
+				pos_play(&p, side, empty[cell]);
+				empty[cell] = empty[--n];
+			}
+			pos_add(c, &p);
+		}
+}
+
+//boards filled without a line until at most three cells are left, the worst
+//case of a scan for a line or an empty cell
+static void adversarial_positions(struct perf_corpus* c)
+{
+	struct perf_pos p;
+	int g, i, n, j, left, side, cell, empty[TG_MAX_CELLS];
+	char ch;
+
+	for (g = 0; g < PERF_GEOMETRIES; g++)
+		for (i = 0; i < _adversarial; i++) {
+			pos_start(&p, g);
+			for (n = 0; n < p.game.board.cells; n++)
+				empty[n] = n;
+			left = next_random(&_rng) % 4;
+			for (side = TB_CLIENT; n > left; side = !side) {
+				ch = side == TB_SERVER ? p.ref.server_char : p.ref.client_char;
+				// the first cell of a random order that makes no line
+				for (j = 0, cell = next_random(&_rng) % n; j < n; j++, cell = (cell + 1) % n)
+					if (!ref_makes_line(&p.ref, ch, empty[cell] / p.ref.cols,
+							    empty[cell] % p.ref.cols))
+						break;
+				if (j == n)
+					break;
+				pos_play(&p, side, empty[cell]);
+				empty[cell] = empty[--n];
+			}
+			pos_add(c, &p);
+		}
+}
+
+//packs the positions of c by geometry
+static void batch_positions(struct perf_corpus* c)
+{
+	const struct ttt_grid* board;
+	struct perf_batch* b;
+	int g, i, n;
+
+	if ((c->batch = calloc(PERF_GEOMETRIES, sizeof(*c->batch))) == NULL) {
+		perror("calloc");
+		exit(1);
+	}
+	for (g = 0; g < PERF_GEOMETRIES; g++) {
+		b = &c->batch[g];
+		for (i = n = 0; i < c->n; i++) {
+			board = &c->pos[i].game.board;
+			n += board->rows == _geometries[g].rows && board->cols == _geometries[g].cols &&
+			     board->k == _geometries[g].k;
+		}
+		if (bt_init(&b->boards, _geometries[g].rows, _geometries[g].cols, _geometries[g].k, n) == -1 ||
+		    (b->pos = malloc(n * sizeof(*b->pos) + 1)) == NULL ||
+		    (b->status = malloc(b->boards.size + 1)) == NULL ||
+		    (b->legal = malloc(b->boards.size * b->boards.geom.words * sizeof(*b->legal) + 1)) == NULL) {
+			perror("batch");
+			exit(1);
+		}
+		for (i = 0; i < c->n; i++) {
+			board = &c->pos[i].game.board;
+			if (board->rows == _geometries[g].rows && board->cols == _geometries[g].cols &&
+			    board->k == _geometries[g].k)
+				b->pos[bt_add(&b->boards, board)] = i;
+		}
+	}
+}
+
+//client moves of random games, one in eight of them invalid, and the answers
+//of the reference
+static void random_scripts(struct perf_corpus* c)
+{
+	struct perf_script* s;
+	struct ref_game ref;
+	struct move* mv;
+	int g, i, r, col;
+
+	c->nscripts = PERF_GEOMETRIES;
+	if ((c->script = calloc(c->nscripts, sizeof(*c->script))) == NULL) {
+		perror("calloc");
+		exit(1);
+	}
+	for (g = 0; g < PERF_GEOMETRIES; g++) {
+		s = &c->script[g];
+		handshake_for(&s->hndshk, g);
+		ref_init(&ref, &s->hndshk);
+		// a game takes at most half the cells from the client, plus invalid moves
+		s->n = _games * (ref.rows * ref.cols / 2 + 2);
+		s->client = malloc(s->n * sizeof(*s->client));
+		s->reply = malloc(s->n * sizeof(*s->reply));
+		if (s->client == NULL || s->reply == NULL) {
+			perror("malloc");
+			exit(1);
+		}
+		for (i = 0; i < s->n; i++) {
+			mv = &s->client[i];
+			if (next_random(&_rng) % 8 == 0) {
+				mv->row = (int) (next_random(&_rng) % (ref.rows + 2)) - 1;
+				mv->col = (int) (next_random(&_rng) % (ref.cols + 2)) - 1;
+			}
+			else {
+				do {
+					r = next_random(&_rng) % ref.rows;
+					col = next_random(&_rng) % ref.cols;
+				} while (ref.board[r][col] != EMPTY_CELL);
+				mv->row = r;
+				mv->col = col;
+			}
+			mv->status = STATUS_OK;
+			ref_play(&ref, mv, &s->reply[i]);
+		}
+	}
+}
+
+/*****************************************************************************/
+/*                          Passes and checks                                */
+/*****************************************************************************/
+
+static long pass_status(struct perf_corpus* c, int* out)
+{
+	int i;
+
+	for (i = 0; i < c->n; i++)
+		out[i] = ttt_status(&c->pos[i].game);
+	return c->n;
+}
+
+static long pass_ref_status(struct perf_corpus* c, int* out)
+{
+	int i;
+
+	for (i = 0; i < c->n; i++)
+		out[i] = ref_status(&c->pos[i].ref);
+	return c->n;
+}
+
+static long check_status(struct perf_corpus* c, const int* out)
+{
+	long bad = 0;
+	int i;
+
+	for (i = 0; i < c->n; i++)
+		bad += out[i] != c->pos[i].status;
+	return bad;
+}
+
+static long pass_batch(struct perf_corpus* c, int* out)
+{
+	int g;
+
+	(void) out;	// the results stay in the batches
+	for (g = 0; g < PERF_GEOMETRIES; g++)
+		bt_eval(&c->batch[g].boards, c->batch[g].status, c->batch[g].legal);
+	return c->n;
+}
+
+static long check_batch(struct perf_corpus* c, const int* out)
+{
+	const struct perf_batch* b;
+	const struct perf_pos* p;
+	long bad = 0;
+	int g, i, cell, wrong;
+
+	(void) out;
+	for (g = 0; g < PERF_GEOMETRIES; g++) {
+		b = &c->batch[g];
+		for (i = 0; i < b->boards.n; i++) {
+			p = &c->pos[b->pos[i]];
+			for (cell = wrong = 0; cell < p->game.board.cells; cell++)
+				wrong |= bt_is_legal(&b->boards, b->legal, i, cell) !=
+					 (p->ref.board[cell / p->ref.cols][cell % p->ref.cols] == EMPTY_CELL);
+			bad += b->status[i] != p->status || wrong;
+		}
+	}
+	return bad;
+}
+
+//every cell of the board and one cell past each border
+static long pass_valid(struct perf_corpus* c, int* out)
+{
+	struct move mv;
+	long n = 0;
+	int i, cell;
+
+	for (i = 0; i < c->n; i++) {
+		const struct ttt_game* game = &c->pos[i].game;
+
+		for (cell = 0; cell < game->board.cells; cell++) {
+			mv.row = cell / game->board.cols;
+			mv.col = cell % game->board.cols;
+			out[n++] = validMove(game, &mv);
+		}
+		mv.row = -1;
+		mv.col = 0;
+		out[n++] = validMove(game, &mv);
+		mv.row = game->board.rows;
+		out[n++] = validMove(game, &mv);
+		mv.row = 0;
+		mv.col = -1;
+		out[n++] = validMove(game, &mv);
+		mv.col = game->board.cols;
+		out[n++] = validMove(game, &mv);
+	}
+	return n;
+}
+
+static long pass_ref_valid(struct perf_corpus* c, int* out)
+{
+	struct move mv;
+	long n = 0;
+	int i, cell;
+
+	for (i = 0; i < c->n; i++) {
+		const struct ref_game* g = &c->pos[i].ref;
+
+		for (cell = 0; cell < g->rows * g->cols; cell++) {
+			mv.row = cell / g->cols;
+			mv.col = cell % g->cols;
+			out[n++] = ref_valid(g, &mv);
+		}
+		mv.row = -1;
+		mv.col = 0;
+		out[n++] = ref_valid(g, &mv);
+		mv.row = g->rows;
+		out[n++] = ref_valid(g, &mv);
+		mv.row = 0;
+		mv.col = -1;
+		out[n++] = ref_valid(g, &mv);
+		mv.col = g->cols;
+		out[n++] = ref_valid(g, &mv);
+	}
+	return n;
+}
+
+static long check_valid(struct perf_corpus* c, const int* out)
+{
+	struct move mv;
+	long bad = 0, n = 0;
+	int i, cell;
+
+	for (i = 0; i < c->n; i++) {
+		const struct ref_game* g = &c->pos[i].ref;
+
+		for (cell = -4; cell < g->rows * g->cols; cell++) {
+			mv.row = cell < 0 ? 0 : cell / g->cols;
+			mv.col = cell < 0 ? 0 : cell % g->cols;
+			if (cell == -4 || cell == -3)
+				mv.row = cell == -4 ? -1 : g->rows;
+			if (cell == -2 || cell == -1)
+				mv.col = cell == -2 ? -1 : g->cols;
+			// the borders come after the cells in a pass
+			bad += out[cell < 0 ? n + g->rows * g->cols + cell + 4 : n + cell] != ref_valid(g, &mv);
+		}
+		n += g->rows * g->cols + 4;
+	}
+	return bad;
+}
+
+//counterAttack() on the positions still in play, at the level of game
+static long attack(struct perf_corpus* c, int* out, int limit)
+{
+	struct move mv;
+	long n = 0;
+	int i, cell;
+
+	for (i = 0; i < c->n && n < limit; i++) {
+		struct ttt_game* game = &c->pos[i].game;
+
+		if (c->pos[i].status != STATUS_OK)
+			continue;
+		mv.row = mv.col = -1;
+		counterAttack(game, &mv);
+		cell = mv.row < 0 ? TB_NO_CELL : mv.row * game->board.cols + mv.col;
+		if (cell != TB_NO_CELL)
+			tg_undo(&game->board, TB_SERVER, cell);
+		out[n++] = cell;
+	}
+	return n;
+}
+
+static void set_level(struct perf_corpus* c, int level)
+{
+	int i;
+
+	for (i = 0; i < c->n; i++)
+		c->pos[i].game.level = level;
+}
+
+static long pass_first_empty(struct perf_corpus* c, int* out)
+{
+	return attack(c, out, c->n);
+}
+
+static long check_first_empty(struct perf_corpus* c, const int* out)
+{
+	long bad = 0, n = 0;
+	int i;
+
+	for (i = 0; i < c->n; i++)
+		if (c->pos[i].status == STATUS_OK)
+			bad += out[n++] != c->pos[i].first;
+	return bad;
+}
+
+static long pass_search(struct perf_corpus* c, int* out)
+{
+	return attack(c, out, c->search_level >= TS_LEVEL_PERFECT ? c->n : _searched);
+}
+
+//a perfect server keeps the value of the position, a searching one wins in one
+static long check_search(struct perf_corpus* c, const int* out)
+{
+	struct ref_game* g;
+	long bad = 0, n = 0;
+	int i, r, col, value;
+
+	for (i = 0; i < c->n && n < (c->search_level >= TS_LEVEL_PERFECT ? c->n : _searched); i++) {
+		if (c->pos[i].status != STATUS_OK)
+			continue;
+		g = &c->pos[i].ref;
+		r = out[n] / g->cols;
+		col = out[n++] % g->cols;
+		if (out[n - 1] == TB_NO_CELL || g->board[r][col] != EMPTY_CELL) {
+			bad++;
+			continue;
+		}
+		if (c->search_level < TS_LEVEL_PERFECT) {
+			bad += c->pos[i].win && !ref_makes_line(g, g->server_char, r, col);
+			continue;
+		}
+		if (c->pos[i].game.board.moves % 2 == 0)
+			continue;	// the server never moves here
+		value = ref_value(g, g->server_char, g->client_char);
+		g->board[r][col] = g->server_char;
+		bad += -ref_value(g, g->client_char, g->server_char) != value;
+		g->board[r][col] = EMPTY_CELL;
+	}
+	return bad;
+}
+
+//packs a reply in one int
+static int reply_code(const struct move* mv)
+{
+	return (mv->status + 8) << 16 | mv->row << 8 | mv->col;
+}
+
+static long pass_play(struct perf_corpus* c, int* out)
+{
+	struct ttt_game game;
+	struct move reply;
+	long n = 0;
+	int s, i;
+
+	for (s = 0; s < c->nscripts; s++) {
+		init_new_game(&game, &c->script[s].hndshk);
+		for (i = 0; i < c->script[s].n; i++) {
+			ttt_play(&game, &c->script[s].client[i], &reply);
+			out[n++] = reply_code(&reply);
+		}
+		end_game(&game);
+	}
+	return n;
+}
+
+static long pass_ref_play(struct perf_corpus* c, int* out)
+{
+	struct ref_game g;
+	struct move reply;
+	long n = 0;
+	int s, i;
+
+	for (s = 0; s < c->nscripts; s++) {
+		ref_init(&g, &c->script[s].hndshk);
+		for (i = 0; i < c->script[s].n; i++) {
+			ref_play(&g, &c->script[s].client[i], &reply);
+			out[n++] = reply_code(&reply);
+		}
+	}
+	return n;
+}
+
+static long check_play(struct perf_corpus* c, const int* out)
+{
+	long bad = 0, n = 0;
+	int s, i;
+
+	for (s = 0; s < c->nscripts; s++)
+		for (i = 0; i < c->script[s].n; i++)
+			bad += out[n++] != reply_code(&c->script[s].reply[i]);
+	return bad;
+}
+
+/*****************************************************************************/
+/*                              Main Program                                 */
+/*****************************************************************************/
+
+//checks one pass of the function, then times it; returns the mismatches
+static long measure(struct perf_corpus* c, const char* function, perf_pass pass, perf_check check)
+{
+	long ops, total = 0, allocs, bad;
+	long long start, elapsed;
+
+	ops = pass(c, _out);
+	bad = check != NULL ? check(c, _out) : 0;
+	allocs = _allocs;
+	start = now_ns();
+	do
+		total += pass(c, _out);
+	while ((elapsed = now_ns() - start) < _min_ns && ops > 0);
+	allocs = _allocs - allocs;
+
+	printf("%-12s %-18s %8ld %10.1f %10.3f  %s\n", c->name, function, ops,
+	       total ? (double) elapsed / total : 0.0, total ? (double) allocs / total : 0.0,
+	       check == NULL ? "-" : bad ? "MISMATCH" : "ok");
+	return bad;
+}
+
+static void usage(const char* name)
+{
+	fprintf(stderr, "usage: %s [-r positions] [-a positions] [-g games] [-p positions]\n"
+		"       [-m ms] [-b bookfile] [-s seed] [-L logfile]\n", name);
+	exit(1);
+}
+
+int main(int argc, char* argv[])
+{
+	static unsigned char seen[PERF_CLASSIC_POSITIONS];
+	struct perf_corpus corpora[3] = {
+		{ .name = "enumeration", .search_level = TS_LEVEL_PERFECT },
+		{ .name = "random", .search_level = 2 },
+		{ .name = "adversarial", .search_level = 2 },
+	};
+	struct perf_corpus games = { .name = "games" };
+	struct perf_pos start;
+	const char* book = "ttt.book";
+	const char* log = NULL;
+	static const char* kernels[] = { "avx2", "sse2", "scalar" };
+	long bad = 0, most = 0, ops;
+	char function[32];
+	int i, s, k, opt;
+
+	while ((opt = getopt(argc, argv, "r:a:g:p:m:b:s:L:")) != -1) {
+		switch (opt) {
+			case 'r': _random = atoi(optarg); break;
+			case 'a': _adversarial = atoi(optarg); break;
+			case 'g': _games = atoi(optarg); break;
+			case 'p': _searched = atoi(optarg); break;
+			case 'm': _min_ns = atol(optarg) * 1000000LL; break;
+			case 'b': book = optarg; break;
+			case 'L': log = optarg; break;
+			case 's': _rng = strtoull(optarg, NULL, 0) * 0x9e3779b97f4a7c15ULL + 1; break;
+			default: usage(argv[0]);
+		}
+	}
+	if (_random < 0 || _adversarial < 0 || _games < 0 || _searched < 0)
+		usage(argv[0]);
+	if (bk_open(book) == -1)
+		fprintf(stderr, "%s: no book in %s, perfect play is searched\n", argv[0], book);
+
+	if (log != NULL && (lg_init(log, LG_ROTATE_BYTES) == -1 || lg_start() == -1)) {
+		perror(log);
+		exit(1);
+	}
+
+	pos_start(&start, 0);
+	enumerate(&corpora[0], &start, TB_CLIENT, seen);
+	random_positions(&corpora[1]);
+	adversarial_positions(&corpora[2]);
+	random_scripts(&games);
+	for (i = 0; i < 3; i++)
+		batch_positions(&corpora[i]);
+
+	// room for the results of a pass of validMove()
+	for (i = 0; i < 3; i++)
+		if (corpora[i].n > most)
+			most = corpora[i].n;
+	most *= TG_MAX_CELLS + 4;
+	for (s = 0, ops = 0; s < games.nscripts; s++)
+		ops += games.script[s].n;
+	if ((_out = malloc((most > ops ? most : ops) * sizeof(*_out))) == NULL) {
+		perror("malloc");
+		exit(1);
+	}
+
+	printf("%-12s %-18s %8s %10s %10s  %s\n", "corpus", "function", "ops", "ns/op", "allocs/op", "check");
+	for (i = 0; i < 3; i++) {
+		struct perf_corpus* c = &corpora[i];
+
+		bad += measure(c, "ttt_status", pass_status, check_status);
+		measure(c, "  reference", pass_ref_status, NULL);
+		bad += measure(c, "validMove", pass_valid, check_valid);
+		measure(c, "  reference", pass_ref_valid, NULL);
+		for (k = 0; k < 3; k++)
+			if (bt_use(kernels[k]) == 0) {
+				sprintf(function, "bt_eval/%s", kernels[k]);
+				bad += measure(c, function, pass_batch, check_batch);
+			}
+		set_level(c, TS_LEVEL_FIRST_EMPTY);
+		bad += measure(c, "counterAttack/0", pass_first_empty, check_first_empty);
+		set_level(c, c->search_level);
+		sprintf(function, "counterAttack/%d", c->search_level);
+		bad += measure(c, function, pass_search, check_search);
+	}
+	bad += measure(&games, "ttt_play/0", pass_play, check_play);
+	measure(&games, "  reference", pass_ref_play, NULL);
+	lg_stop();
+
+	if (bad) {
+		printf("%ld results differ from the reference\n", bad);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,337 @@
+/******************************************************************************
+  Title          : tttpool.c
+  Author         : Andriy Goltsev
+  Description    : Dispatcher of the worker pool
+
+  Notes          : The dispatcher polls the public FIFO, the listening and
+                   stats sockets and its end of every worker's socketpair;
+                   a hang-up on the last means the worker died. It is
+                   reaped and forked again, but not sooner than
+                   WP_RESPAWN_MS after it was last started, so a worker
+                   that cannot run does not turn the dispatcher into a
+                   fork loop.
+
+                   The dispatcher's ends are non-blocking: a worker too
+                   busy to take its messages is passed over for the next
+                   least loaded one.
+
+******************************************************************************/
+
+#define _GNU_SOURCE	// accept4(), sched_setaffinity()
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <sched.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <syslog.h>
+#include "ttt.h"
+#include "tttpool.h"
+#include "tttevent.h"
+#include "tttproto.h"
+#include "tttsock.h"
+#include "tttstats.h"
+#include "tttrecord.h"
+#include "tttsuper.h"
+#include "tttadmit.h"
+
+#define WP_RESPAWN_MS	1000
+
+struct worker {
+	pid_t pid;
+	int control;		// the dispatcher's end, -1 while the worker is down
+	int cpu;		// it is pinned to, or -1
+	long long started;	// ms
+};
+
+static struct worker _workers[WP_MAX_WORKERS];
+static int _nworkers;
+static struct wp_load* _loads;		// shared with the workers
+static int _next;			// where the search for the least loaded starts
+static int _fds[3];			// the dispatcher's: public FIFO, listening and stats sockets
+
+static long long now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+//work() flushes the records once ev_worker() has returned
+static void on_worker_signal(int sig)
+{
+	sv_stopping = 1;
+}
+
+//runs in the child: serves the clients of worker w until the dispatcher is gone
+static void work(int w, int control)
+{
+	struct sigaction handler;
+	cpu_set_t cpus;
+	int i;
+
+	// the dispatcher's descriptors are not the worker's business; its
+	// signal handler would remove the public FIFO and the sockets
+	for (i = 0; i < 3; i++)
+		if (_fds[i] != -1)
+			close(_fds[i]);
+	for (i = 0; i < _nworkers; i++)
+		if (_workers[i].control != -1)
+			close(_workers[i].control);
+	memset(&handler, 0, sizeof(handler));
+	handler.sa_handler = on_worker_signal;
+	sigaction(SIGTERM, &handler, NULL);
+	sigaction(SIGQUIT, &handler, NULL);
+	handler.sa_handler = SIG_DFL;
+	sigaction(SIGCHLD, &handler, NULL);
+
+	if (_workers[w].cpu != -1) {
+		CPU_ZERO(&cpus);
+		CPU_SET(_workers[w].cpu, &cpus);
+		if (sched_setaffinity(0, sizeof(cpus), &cpus) == -1)
+			syslog(LOG_WARNING, "worker %d: CPU %d: %m", w, _workers[w].cpu);
+	}
+	if (ev_worker(control, &_loads[w]) == -1) {
+		syslog(LOG_ERR, "worker %d: %m", w);
+		gr_flush();
+		exit(1);
+	}
+	gr_flush();
+	exit(0);
+}
+
+static int spawn(int w)
+{
+	int sv[2];
+	pid_t pid;
+
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) == -1)
+		return -1;
+	_loads[w].pending = _loads[w].sessions = 0;
+	_workers[w].started = now_ms();
+	if ((pid = fork()) == -1) {
+		close(sv[0]);
+		close(sv[1]);
+		return -1;
+	}
+	if (pid == 0) {
+		close(sv[0]);
+		work(w, sv[1]);
+	}
+	close(sv[1]);
+	if (fcntl(sv[0], F_SETFL, O_NONBLOCK) == -1) {
+		close(sv[0]);	// the worker sees the hang-up and exits
+		return -1;
+	}
+	_workers[w].pid = pid;
+	_workers[w].control = sv[0];
+	return 0;
+}
+
+//closes the control socket of a worker that hung up and collects it
+static void reap(int w)
+{
+	int status;
+
+	close(_workers[w].control);
+	_workers[w].control = -1;
+	if (waitpid(_workers[w].pid, &status, 0) == -1)
+		return;
+	if (WIFSIGNALED(status))
+		syslog(LOG_WARNING, "worker %d (pid %d) killed by signal %d",
+		       w, (int) _workers[w].pid, WTERMSIG(status));
+	else
+		syslog(LOG_WARNING, "worker %d (pid %d) exited with %d",
+		       w, (int) _workers[w].pid, WEXITSTATUS(status));
+}
+
+//returns the worker with the fewest clients, not counting the tried ones,
+//or -1 if none is up
+static int least_loaded(const char* tried)
+{
+	int i, w, load, best = -1, best_load = INT_MAX;
+
+	for (i = 0; i < _nworkers; i++) {
+		w = (_next + i) % _nworkers;	// ties go round
+		if (_workers[w].control == -1 || tried[w])
+			continue;
+		load = __atomic_load_n(&_loads[w].pending, __ATOMIC_RELAXED) +
+		       __atomic_load_n(&_loads[w].sessions, __ATOMIC_RELAXED);
+		if (load < best_load) {
+			best = w;
+			best_load = load;
+		}
+	}
+	if (best != -1)
+		_next = best + 1;
+	return best;
+}
+
+//sessions of all workers, including those handed over
+static int active(void)
+{
+	int i, n = 0;
+
+	for (i = 0; i < _nworkers; i++)
+		n += __atomic_load_n(&_loads[i].pending, __ATOMIC_RELAXED) +
+		     __atomic_load_n(&_loads[i].sessions, __ATOMIC_RELAXED);
+	return n;
+}
+
+//sends a new client to the least loaded worker: the len bytes at data and
+//fd, unless it is -1
+static void hand_over(const struct wp_handoff* h, const void* data, int len, int fd)
+{
+	unsigned char buf[sizeof(*h) + sizeof(struct handshake)];
+	char tried[WP_MAX_WORKERS];
+	int w;
+
+	memcpy(buf, h, sizeof(*h));
+	if (len > 0)
+		memcpy(buf + sizeof(*h), data, len);
+	memset(tried, 0, _nworkers);
+	while ((w = least_loaded(tried)) != -1) {
+		__atomic_add_fetch(&_loads[w].pending, 1, __ATOMIC_RELAXED);
+		if (us_send_fds(_workers[w].control, buf, sizeof(*h) + len, &fd, fd != -1) != -1)
+			return;
+		__atomic_sub_fetch(&_loads[w].pending, 1, __ATOMIC_RELAXED);
+		tried[w] = 1;
+	}
+	syslog(LOG_WARNING, "no worker takes clients, one dropped");
+}
+
+//hands an admitted client (tttadmit.h) over
+static void start(const struct ad_client* c)
+{
+	struct wp_handoff h;
+
+	h.since = c->since;
+	if (c->fd != -1) {
+		h.kind = WP_SOCKET;
+		hand_over(&h, NULL, 0, c->fd);
+		close(c->fd);	// the worker has its own copy
+		return;
+	}
+	h.kind = WP_FIFO;
+	hand_over(&h, &c->hello, sizeof(c->hello), -1);
+}
+
+static void on_connect(int listensock)
+{
+	struct ad_client c;
+
+	while ((c.fd = accept4(listensock, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1) {
+		c.since = st_now();
+		if (ad_admit(&c, active()) == AD_ADMIT)
+			start(&c);
+	}
+}
+
+//returns -1 if the public FIFO fails
+static int on_handshake(int publicfifo)
+{
+	static struct tp_reader hellos;
+	struct ad_client c;
+	const unsigned char* frame;
+	int len;
+
+	// a hello is written atomically, but several may be waiting
+	if (tp_fill(&hellos, publicfifo, NULL, 0) <= 0)
+		return -1;
+	c.fd = -1;
+	c.since = st_now();
+	while ((len = tp_next(&hellos, &frame)) > 0)
+		if (tp_get_hello(frame, len, &c.hello) == 0 && ad_admit(&c, active()) == AD_ADMIT)
+			start(&c);
+	if (len == -1) {
+		syslog(LOG_WARNING, "garbage on %s dropped", PUBLIC);
+		tp_reader_init(&hellos);
+	}
+	return 0;
+}
+
+int wp_run(int workers, int pin, int publicfifo, int listensock, int statsock)
+{
+	struct pollfd fds[3 + WP_MAX_WORKERS];
+	struct ad_client c;
+	cpu_set_t allowed;
+	int cpus[CPU_SETSIZE], ncpus = 0;
+	int i, down;
+	long long now;
+
+	if (sched_getaffinity(0, sizeof(allowed), &allowed) == -1)
+		return -1;
+	for (i = 0; i < CPU_SETSIZE; i++)
+		if (CPU_ISSET(i, &allowed))
+			cpus[ncpus++] = i;
+	if (workers <= 0)
+		workers = ncpus;
+	if (workers > WP_MAX_WORKERS)
+		workers = WP_MAX_WORKERS;
+	_loads = mmap(NULL, workers * sizeof(*_loads), PROT_READ | PROT_WRITE,
+	              MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (_loads == MAP_FAILED)
+		return -1;
+	if (listensock != -1 &&
+	    fcntl(listensock, F_SETFL, fcntl(listensock, F_GETFL) | O_NONBLOCK) == -1)
+		return -1;
+	_fds[0] = publicfifo;
+	_fds[1] = listensock;
+	_fds[2] = statsock;
+	for (i = 0; i < workers; i++) {
+		_workers[i].control = -1;
+		_workers[i].cpu = pin ? cpus[i % ncpus] : -1;
+	}
+	_nworkers = workers;
+	for (i = 0; i < workers; i++)
+		if (spawn(i) == -1)
+			return -1;
+	syslog(LOG_INFO, "%d workers%s", workers, pin ? ", pinned" : "");
+
+	for (i = 0; i < 3; i++) {
+		fds[i].fd = _fds[i];	// ignored by poll() when -1
+		fds[i].events = POLLIN;
+	}
+	for (;;) {
+		if (sv_stopping)
+			return 0;
+		for (i = down = 0; i < _nworkers; i++) {
+			fds[3 + i].fd = _workers[i].control;
+			fds[3 + i].events = 0;	// a hang-up is always reported
+			down += _workers[i].control == -1;
+		}
+		// the workers do not tell when a session ends, so waiting
+		// clients are checked often
+		if (poll(fds, 3 + _nworkers, ad_waiting() ? AD_POLL_MS :
+			 down ? WP_RESPAWN_MS : SV_TICK_MS) == -1) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		for (i = 0; i < _nworkers; i++)
+			if (fds[3 + i].fd != -1 && fds[3 + i].revents)
+				reap(i);
+		now = now_ms();
+		for (i = 0; i < _nworkers; i++)
+			if (_workers[i].control == -1 && now - _workers[i].started >= WP_RESPAWN_MS &&
+			    spawn(i) == -1)
+				syslog(LOG_ERR, "worker %d: %m", i);
+		sv_sweep(now);	// the workers expire their own sessions
+		while (ad_dequeue(&c, active()))
+			start(&c);
+		if (fds[2].revents & POLLIN)
+			st_serve(statsock);
+		if (fds[1].revents & POLLIN)
+			on_connect(listensock);
+		if ((fds[0].revents & POLLIN) && on_handshake(publicfifo) == -1)
+			return -1;
+	}
+}
@@ -0,0 +1,56 @@
+/******************************************************************************
+  Title          : tttpool.h
+  Author         : Andriy Goltsev
+  Description    : Pre-forked pool of event-loop workers
+
+  Notes          : tttserver -w forks its workers once, at startup, instead
+                   of a process per client. Each worker runs the event loop
+                   of tttevent.h over many sessions, optionally pinned to a
+                   CPU of its own. The server process stays the dispatcher:
+                   it reads the hellos on the public FIFO and accepts the
+                   connections on the listening socket, and hands each new
+                   client to the worker with the least load over a
+                   SOCK_SEQPACKET socketpair. A hello from the FIFO travels,
+                   decoded, in the message; a connection is passed with
+                   SCM_RIGHTS, unread, so its worker reads the hello (and
+                   any shared-memory rings) itself.
+
+                   The load of a worker is a struct wp_load in memory
+                   shared by all of them: clients handed over but not yet
+                   taken, counted up by the dispatcher, and the worker's
+                   open sessions. No handshake waits for a fork(). A worker
+                   that dies is forked again; workers exit when the
+                   dispatcher goes away.
+
+******************************************************************************/
+
+#ifndef TTTPOOL_H
+#define TTTPOOL_H
+
+#define WP_MAX_WORKERS	256
+
+enum wp_kind {
+	WP_FIFO,	// the decoded hello follows the struct wp_handoff
+	WP_SOCKET	// the connection comes with the message
+};
+
+// what the dispatcher sends a worker for each new client
+struct wp_handoff {
+	long long since;	// st_now() when the client came
+	int kind;		// enum wp_kind
+};
+
+// one per worker, on its own cache line
+struct wp_load {
+	int pending;		// handed over, not taken yet
+	int sessions;		// open in the worker
+} __attribute__((aligned(64)));
+
+//forks workers (one per CPU the server may run on if workers is 0), pinned
+//to CPUs when pin is set, and dispatches the clients of publicfifo and,
+//unless it is -1, listensock to them; serves the stats on statsock unless
+//it is -1. Returns -1 with errno set on an error, 0 once sv_stopping is set
+//(tttsuper.h)
+int wp_run(int workers, int pin, int publicfifo, int listensock, int statsock);
+
+#endif
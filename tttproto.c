@@ -0,0 +1,275 @@
+/******************************************************************************
+  Title          : tttproto.c
+  Author         : Andriy Goltsev
+  Description    : Encoding and validation of the frames of tttproto.h
+
+******************************************************************************/
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "tttproto.h"
+#include "tttsock.h"
+
+static unsigned char* put_header(unsigned char* buf, int type, int length)
+{
+	buf[0] = type;
+	buf[1] = length & 0xff;
+	buf[2] = length >> 8;
+	return buf + TP_HEADER_BYTES;
+}
+
+static int payload_length(const unsigned char* frame)
+{
+	return frame[1] | frame[2] << 8;
+}
+
+static unsigned char* put_name(unsigned char* p, const char* name)
+{
+	int n = strnlen(name, MAX_FIFO_NAME);
+
+	*p++ = n;
+	memcpy(p, name, n);
+	return p + n;
+}
+
+int tp_put_hello(unsigned char* buf, const struct handshake* hndshk)
+{
+	unsigned char* p = buf + TP_HEADER_BYTES;
+
+	*p++ = 'T';
+	*p++ = 'T';
+	*p++ = TP_VERSION;
+	*p++ = hndshk->client_char;
+	*p++ = hndshk->server_char;
+	*p++ = hndshk->level;
+	*p++ = hndshk->rows;
+	*p++ = hndshk->cols;
+	*p++ = hndshk->win_len;
+	*p++ = hndshk->engine;
+	*p++ = hndshk->transport;
+	p = put_name(p, hndshk->client_in_fifo);
+	p = put_name(p, hndshk->client_out_fifo);
+	put_header(buf, TP_HELLO, p - buf - TP_HEADER_BYTES);
+	return p - buf;
+}
+
+int tp_put_welcome(unsigned char* buf, const struct tp_welcome* w)
+{
+	int len = w->version >= 2 ? TP_WELCOME_BYTES : TP_WELCOME_V1_BYTES;
+	unsigned char* p = put_header(buf, TP_WELCOME, len - TP_HEADER_BYTES);
+
+	p[0] = w->version;
+	p[1] = (signed char) w->status;
+	p[2] = w->engine;
+	p[3] = w->transport;
+	p[4] = w->max_side;
+	if (w->version >= 2) {
+		p[5] = w->max_games & 0xff;
+		p[6] = w->max_games >> 8;
+	}
+	return len;
+}
+
+int tp_put_game_move(unsigned char* buf, int id, const struct move* mv)
+{
+	unsigned char* p = put_header(buf, TP_GAME_MOVE, TP_GAME_MOVE_BYTES - TP_HEADER_BYTES);
+
+	p[0] = id & 0xff;
+	p[1] = id >> 8;
+	p[2] = (signed char) mv->status;
+	p[3] = mv->row;
+	p[4] = mv->col;
+	return TP_GAME_MOVE_BYTES;
+}
+
+int tp_put_move(unsigned char* buf, const struct move* mv)
+{
+	unsigned char* p = put_header(buf, TP_MOVE, TP_MOVE_BYTES - TP_HEADER_BYTES);
+
+	p[0] = (signed char) mv->status;
+	p[1] = mv->row;
+	p[2] = mv->col;
+	return TP_MOVE_BYTES;
+}
+
+//copies a name of the hello at *p into name; returns -1 if it overruns end
+static int get_name(const unsigned char** p, const unsigned char* end, char* name)
+{
+	int n;
+
+	if (*p >= end || (n = **p) > end - *p - 1)
+		return -1;
+	memcpy(name, *p + 1, n);
+	name[n] = '\0';
+	*p += n + 1;
+	return 0;
+}
+
+int tp_get_hello(const unsigned char* frame, int len, struct handshake* hndshk)
+{
+	const unsigned char* p = frame + TP_HEADER_BYTES;
+	const unsigned char* end = frame + len;
+
+	if (tp_type(frame) != TP_HELLO || len < TP_HEADER_BYTES + 13 ||
+	    p[0] != 'T' || p[1] != 'T' || p[2] == 0)
+		return -1;
+	// a newer client is answered in TP_VERSION, which it must still speak
+	memset(hndshk, 0, sizeof(*hndshk));
+	hndshk->version = p[2];
+	hndshk->client_char = p[3];
+	hndshk->server_char = p[4];
+	hndshk->level = p[5];
+	hndshk->rows = p[6];
+	hndshk->cols = p[7];
+	hndshk->win_len = p[8];
+	hndshk->engine = p[9];
+	hndshk->transport = p[10];
+	p += 11;
+	if (get_name(&p, end, hndshk->client_in_fifo) == -1 ||
+	    get_name(&p, end, hndshk->client_out_fifo) == -1 || p != end)
+		return -1;
+	return 0;
+}
+
+int tp_get_welcome(const unsigned char* frame, int len, struct tp_welcome* w)
+{
+	const unsigned char* p = frame + TP_HEADER_BYTES;
+
+	if (tp_type(frame) != TP_WELCOME || p[0] == 0 ||
+	    len != (p[0] >= 2 ? TP_WELCOME_BYTES : TP_WELCOME_V1_BYTES))
+		return -1;
+	w->version = p[0];
+	w->status = (signed char) p[1];
+	w->engine = p[2];
+	w->transport = p[3];
+	w->max_side = p[4];
+	w->max_games = p[0] >= 2 ? p[5] | p[6] << 8 : 1;
+	return 0;
+}
+
+int tp_get_move(const unsigned char* frame, int len, struct move* mv)
+{
+	const unsigned char* p = frame + TP_HEADER_BYTES;
+
+	if (tp_type(frame) != TP_MOVE || len != TP_MOVE_BYTES)
+		return -1;
+	mv->status = (signed char) p[0];
+	mv->row = p[1];
+	mv->col = p[2];
+	return 0;
+}
+
+int tp_get_game_move(const unsigned char* frame, int len, int* id, struct move* mv)
+{
+	const unsigned char* p = frame + TP_HEADER_BYTES;
+
+	if (tp_type(frame) != TP_GAME_MOVE || len != TP_GAME_MOVE_BYTES)
+		return -1;
+	*id = p[0] | p[1] << 8;
+	mv->status = (signed char) p[2];
+	mv->row = p[3];
+	mv->col = p[4];
+	return 0;
+}
+
+void tp_reader_init(struct tp_reader* r)
+{
+	r->start = r->have = 0;
+}
+
+int tp_fill(struct tp_reader* r, int fd, int* fds, int nfds)
+{
+	int n;
+
+	if (r->start > 0) {
+		memmove(r->buf, r->buf + r->start, r->have - r->start);
+		r->have -= r->start;
+		r->start = 0;
+	}
+	if (fds != NULL)
+		n = us_recv_fds(fd, r->buf + r->have, TP_BUFFER - r->have, fds, nfds);
+	else
+		while ((n = read(fd, r->buf + r->have, TP_BUFFER - r->have)) == -1 && errno == EINTR)
+			;
+	if (n > 0)
+		r->have += n;
+	return n;
+}
+
+int tp_pending(const struct tp_reader* r)
+{
+	const unsigned char* p = r->buf + r->start;
+	int avail = r->have - r->start;
+	int len;
+
+	if (avail < TP_HEADER_BYTES)
+		return 0;
+	if ((p[0] != TP_HELLO && p[0] != TP_WELCOME && p[0] != TP_MOVE && p[0] != TP_GAME_MOVE) ||
+	    (len = TP_HEADER_BYTES + payload_length(p)) > TP_MAX_FRAME)
+		return -1;
+	return avail < len ? 0 : len;
+}
+
+int tp_next(struct tp_reader* r, const unsigned char** frame)
+{
+	int len;
+
+	if ((len = tp_pending(r)) <= 0)
+		return len;
+	*frame = r->buf + r->start;
+	r->start += len;
+	if (r->start == r->have)
+		r->start = r->have = 0;
+	return len;
+}
+
+int tp_read_frame(struct tp_reader* r, int fd, const unsigned char** frame)
+{
+	int len, n;
+
+	while ((len = tp_next(r, frame)) == 0) {
+		if ((n = tp_fill(r, fd, NULL, 0)) <= 0)
+			return n;
+	}
+	return len;
+}
+
+int tp_open_fifo(const char* path, int flags)
+{
+	struct stat st;
+	int fd;
+
+	// checked before, so that no device is opened, and after, in case
+	// the name was replaced in between
+	if (lstat(path, &st) == -1)
+		return -1;
+	if (!S_ISFIFO(st.st_mode)) {
+		errno = EINVAL;
+		return -1;
+	}
+	if ((fd = open(path, flags | O_NOFOLLOW)) == -1)
+		return -1;
+	if (fstat(fd, &st) == -1 || !S_ISFIFO(st.st_mode)) {
+		close(fd);
+		errno = EINVAL;
+		return -1;
+	}
+	return fd;
+}
+
+int tp_await(int fd, int ms)
+{
+	struct pollfd p;
+	int n;
+
+	p.fd = fd;
+	p.events = POLLIN;
+	// no POLLHUP before the first writer has come and gone
+	while ((n = poll(&p, 1, ms)) == -1 && errno == EINTR)
+		;
+	if (n <= 0 || !(p.revents & (POLLIN | POLLHUP)))
+		return -1;
+	return fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+}
@@ -0,0 +1,122 @@
+/******************************************************************************
+  Title          : tttproto.h
+  Author         : Andriy Goltsev
+  Description    : Wire format shared by tttclient and tttserver
+
+  Notes          : Everything on a FIFO or socket travels in frames of
+                   one type byte, a little-endian 16-bit payload length and
+                   the payload. All fields are single bytes except the FIFO
+                   names, which are a length byte followed by the name.
+
+                   TP_HELLO    client to server, opens a session:
+                               'T' 'T' version client_char server_char
+                               level rows cols win_len engine transport
+                               in_len in_fifo out_len out_fifo
+                   TP_WELCOME  server to client, the answer to TP_HELLO:
+                               version status engine transport max_side
+                               max_games (16 bits, from version 2)
+                   TP_MOVE     both ways: status row col (status signed)
+                   TP_GAME_MOVE both ways: game (16 bits) status row col
+
+                   The server answers with the version both sides speak
+                   and with the engine and transport it will actually use;
+                   status is INVALID_BOARD when it cannot play the board
+                   asked for and SERVER_BUSY when it will not start the
+                   session now; either way no move is played.
+
+                   A session may play up to max_games games at once.
+                   TP_GAME_MOVE names the game, which the server starts
+                   with the settings of the hello on its first move;
+                   TP_MOVE plays game 0. A client may write up to TP_BUFFER
+                   bytes of move frames at once, and gets the replies in
+                   the same order, several at a time. A reply is as long as
+                   the frame it answers. A hello is at most TP_MAX_FRAME bytes, well
+                   below PIPE_BUF, so it is written to the public FIFO
+                   atomically.
+
+******************************************************************************/
+
+#ifndef TTTPROTO_H
+#define TTTPROTO_H
+
+#include "ttt.h"
+
+#define TP_VERSION	2
+
+#define TP_HELLO	'H'
+#define TP_WELCOME	'W'
+#define TP_MOVE		'M'
+#define TP_GAME_MOVE	'G'
+
+#define TP_HEADER_BYTES		3
+#define TP_MOVE_BYTES		(TP_HEADER_BYTES + 3)
+#define TP_GAME_MOVE_BYTES	(TP_HEADER_BYTES + 5)
+#define TP_WELCOME_V1_BYTES	(TP_HEADER_BYTES + 5)
+#define TP_WELCOME_BYTES	(TP_HEADER_BYTES + 7)
+#define TP_MAX_FRAME		(TP_HEADER_BYTES + 13 + 2 * MAX_FIFO_NAME)
+#define TP_BUFFER		PIPE_BUF	// holds whole socket messages
+
+struct tp_welcome {
+	int version;
+	int status;		// STATUS_OK, INVALID_BOARD or SERVER_BUSY
+	int engine;		// ENGINE_* the server plays with
+	int transport;		// TRANSPORT_* of the session
+	int max_side;		// largest board side the server supports
+	int max_games;		// games a session may play at once
+};
+
+// frames read from one FIFO or socket
+struct tp_reader {
+	unsigned char buf[TP_BUFFER];
+	int start, have;	// unparsed bytes are buf[start .. have)
+};
+
+//encoders return the length of the frame written to buf
+int tp_put_hello(unsigned char* buf, const struct handshake* hndshk);
+int tp_put_welcome(unsigned char* buf, const struct tp_welcome* w);
+int tp_put_move(unsigned char* buf, const struct move* mv);
+int tp_put_game_move(unsigned char* buf, int id, const struct move* mv);
+
+//decoders take a whole frame and return 0, or -1 if it is not valid
+int tp_get_hello(const unsigned char* frame, int len, struct handshake* hndshk);
+int tp_get_welcome(const unsigned char* frame, int len, struct tp_welcome* w);
+int tp_get_move(const unsigned char* frame, int len, struct move* mv);
+int tp_get_game_move(const unsigned char* frame, int len, int* id, struct move* mv);
+
+//type of a frame returned by tp_next()
+#define tp_type(frame)	((frame)[0])
+
+//bytes read into r and not taken yet, whole frames or not
+#define tp_buffered(r)	((r)->have - (r)->start)
+
+void tp_reader_init(struct tp_reader* r);
+
+//reads what is available on fd into r (blocking unless fd is not); when
+//fds is not NULL fd is a socket and up to nfds descriptors passed with the
+//data are stored there. Returns the bytes read, 0 at EOF or -1
+int tp_fill(struct tp_reader* r, int fd, int* fds, int nfds);
+
+//length of the next complete frame of r, without taking it; 0 if more bytes
+//are needed or -1 if the stream is not speaking this protocol
+int tp_pending(const struct tp_reader* r);
+
+//points frame at the next complete frame of r and returns its length, 0 if
+//more bytes are needed or -1 if the stream is not speaking this protocol
+int tp_next(struct tp_reader* r, const unsigned char** frame);
+
+//reads from fd until a whole frame is in r; returns its length as tp_next()
+//does, or 0 at EOF
+int tp_read_frame(struct tp_reader* r, int fd, const unsigned char** frame);
+
+//opens path, a private FIFO named in a hello, with flags; returns -1 with
+//errno EINVAL if it is anything else. The name is the client's word: a
+//regular file there must not be overwritten with a reply
+int tp_open_fifo(const char* path, int flags);
+
+//waits up to ms for data on fd, a FIFO the client opened O_NONBLOCK for
+//reading before the server opened it for writing, then makes fd blocking;
+//returns 0, or -1 if nothing came. A FIFO the client also opened for
+//writing would never see the server's end close, so no EOF either
+int tp_await(int fd, int ms);
+
+#endif
@@ -0,0 +1,293 @@
+/******************************************************************************
+  Title          : tttrecord.c
+  Author         : Andriy Goltsev
+  Description    : Compact append-only records of the games played
+
+  Notes          : The file is opened by the process that writes the first
+                   block, so a forked child gets a file description, and
+                   an offset, of its own: the offset after an O_APPEND
+                   write() is the end of the block just written, which is
+                   what the index records.
+
+******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "tttrecord.h"
+
+int gr_recording;
+
+static char _path[PATH_MAX];
+static char _index_path[PATH_MAX + 8];
+static pid_t _owner;			// process that opened the files
+static int _fd = -1, _index_fd = -1;
+static unsigned char _buffer[GR_BLOCK_BYTES];
+static int _used, _games;
+
+//bits that hold any cell of a board of cells
+static int cell_bits(int cells)
+{
+	return cells <= 1 ? 1 : 32 - __builtin_clz(cells - 1);
+}
+
+/*****************************************************************************/
+/*                                 Writer                                    */
+/*****************************************************************************/
+
+int gr_init(const char* path)
+{
+	int fd;
+
+	if (path[0] == '/')
+		snprintf(_path, sizeof(_path), "%s", path);
+	else if (getcwd(_path, sizeof(_path)) == NULL ||
+		 strlen(_path) + strlen(path) + 2 > sizeof(_path)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	else
+		strcat(strcat(_path, "/"), path);
+	snprintf(_index_path, sizeof(_index_path), "%s.idx", _path);
+	if ((fd = open(_path, O_WRONLY | O_CREAT | O_APPEND, 0644)) == -1)
+		return -1;
+	close(fd);
+	gr_recording = 1;
+	return 0;
+}
+
+void gr_add(const struct ttt_game* game, int result)
+{
+	const struct ttt_grid* b = &game->board;
+	unsigned char* p;
+	int bits = cell_bits(b->cells), i, bit;
+
+	if (_used + GR_GAME_BYTES + (b->moves * bits + 7) / 8 > GR_BLOCK_BYTES)
+		gr_flush();
+	p = _buffer + _used;
+	p[0] = (b->rows - 1) << 4 | (b->cols - 1);
+	p[1] = b->k;
+	p[2] = game->level;
+	p[3] = result | game->engine << 2;
+	p[4] = b->moves & 0xff;
+	p[5] = b->moves >> 8;
+	p += GR_GAME_BYTES;
+	memset(p, 0, (b->moves * bits + 7) / 8);
+	for (i = 0, bit = 0; i < b->moves; i++, bit += bits) {
+		p[bit / 8] |= game->history[i] << (bit % 8);
+		if (bit % 8 + bits > 8)
+			p[bit / 8 + 1] |= game->history[i] >> (8 - bit % 8);
+	}
+	_used += GR_GAME_BYTES + (b->moves * bits + 7) / 8;
+	_games++;
+}
+
+static int write_all(int fd, const void* buf, long len)
+{
+	const char* p = buf;
+	ssize_t w;
+
+	while (len > 0) {
+		if ((w = write(fd, p, len)) == -1) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		p += w;
+		len -= w;
+	}
+	return 0;
+}
+
+void gr_flush(void)
+{
+	struct {
+		struct gr_block head;
+		unsigned char records[GR_BLOCK_BYTES];
+	} block;
+	struct gr_index entry;
+	struct timespec ts;
+	off_t end;
+	long len;
+
+	if (_games == 0)
+		return;
+	if (_owner != getpid()) {
+		// the parent's descriptors would share its offset
+		if (_fd != -1)
+			close(_fd);
+		if (_index_fd != -1)
+			close(_index_fd);
+		_fd = open(_path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+		_index_fd = open(_index_path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+		_owner = getpid();
+	}
+	clock_gettime(CLOCK_REALTIME, &ts);
+	memcpy(block.head.magic, GR_MAGIC, 4);
+	block.head.bytes = _used;
+	block.head.games = _games;
+	block.head.pid = getpid();
+	block.head.ns = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+	memcpy(block.records, _buffer, _used);
+	len = sizeof(block.head) + _used;
+	_used = _games = 0;
+
+	// one write, so that the block of another process cannot land inside
+	if (_fd == -1 || write(_fd, &block, len) != len)
+		return;
+	if (_index_fd == -1 || (end = lseek(_fd, 0, SEEK_CUR)) == -1)
+		return;
+	entry.offset = end - len;
+	entry.bytes = block.head.bytes;
+	entry.games = block.head.games;
+	entry.ns = block.head.ns;
+	write_all(_index_fd, &entry, sizeof(entry));
+}
+
+/*****************************************************************************/
+/*                                 Reader                                    */
+/*****************************************************************************/
+
+int gr_decode(const unsigned char* p, const unsigned char* end, struct gr_game* g)
+{
+	int bits, i, bit, len;
+
+	if (end - p < GR_GAME_BYTES)
+		return -1;
+	g->rows = (p[0] >> 4) + 1;
+	g->cols = (p[0] & 0x0f) + 1;
+	g->k = p[1];
+	g->level = p[2];
+	g->result = p[3] & 3;
+	g->engine = p[3] >> 2;
+	g->moves = p[4] | p[5] << 8;
+	if (g->moves > g->rows * g->cols)
+		return -1;
+	bits = cell_bits(g->rows * g->cols);
+	len = GR_GAME_BYTES + (g->moves * bits + 7) / 8;
+	if (end - p < len)
+		return -1;
+	p += GR_GAME_BYTES;
+	for (i = 0, bit = 0; i < g->moves; i++, bit += bits) {
+		g->cell[i] = p[bit / 8] >> (bit % 8);
+		if (bit % 8 + bits > 8)
+			g->cell[i] |= p[bit / 8 + 1] << (8 - bit % 8);
+		g->cell[i] &= (1 << bits) - 1;
+	}
+	return len;
+}
+
+//adds an entry for every block found by walking the file from the start
+static int walk_blocks(struct gr_file* f)
+{
+	struct gr_block head;
+	long off = 0;
+	int size = 0;
+
+	while (off + (long) sizeof(head) <= f->size) {
+		memcpy(&head, f->base + off, sizeof(head));
+		if (memcmp(head.magic, GR_MAGIC, 4) != 0 || off + (long) sizeof(head) + head.bytes > f->size)
+			break;	// a block cut short by a crash ends the file
+		if (f->nblocks == size) {
+			size = size ? 2 * size : 256;
+			if ((f->blocks = realloc(f->blocks, size * sizeof(*f->blocks))) == NULL)
+				return -1;
+		}
+		f->blocks[f->nblocks].offset = off;
+		f->blocks[f->nblocks].bytes = head.bytes;
+		f->blocks[f->nblocks].games = head.games;
+		f->blocks[f->nblocks++].ns = head.ns;
+		off += sizeof(head) + head.bytes;
+	}
+	return 0;
+}
+
+static int by_offset(const void* a, const void* b)
+{
+	const struct gr_index* x = a;
+	const struct gr_index* y = b;
+
+	return x->offset < y->offset ? -1 : x->offset > y->offset;
+}
+
+//reads path.idx; returns -1 if it is missing or does not cover the file
+//block by block
+static int read_index(const char* path, struct gr_file* f)
+{
+	char index_path[PATH_MAX + 8];
+	struct stat st;
+	struct gr_block head;
+	uint64_t off = 0;
+	int fd, i;
+
+	snprintf(index_path, sizeof(index_path), "%s.idx", path);
+	if ((fd = open(index_path, O_RDONLY)) == -1)
+		return -1;
+	if (fstat(fd, &st) == -1 || st.st_size % sizeof(struct gr_index) != 0 ||
+	    (f->blocks = malloc(st.st_size + 1)) == NULL ||
+	    read(fd, f->blocks, st.st_size) != st.st_size) {
+		close(fd);
+		return -1;
+	}
+	close(fd);
+	f->nblocks = st.st_size / sizeof(struct gr_index);
+	qsort(f->blocks, f->nblocks, sizeof(*f->blocks), by_offset);
+	for (i = 0; i < f->nblocks; i++) {
+		if (f->blocks[i].offset != off || off + sizeof(head) + f->blocks[i].bytes > (uint64_t) f->size)
+			return -1;
+		memcpy(&head, f->base + off, sizeof(head));
+		if (memcmp(head.magic, GR_MAGIC, 4) != 0 || head.bytes != f->blocks[i].bytes)
+			return -1;
+		off += sizeof(head) + head.bytes;
+	}
+	return off == (uint64_t) f->size ? 0 : -1;
+}
+
+int gr_map(const char* path, struct gr_file* f)
+{
+	struct stat st;
+	int fd;
+
+	memset(f, 0, sizeof(*f));
+	if ((fd = open(path, O_RDONLY)) == -1)
+		return -1;
+	if (fstat(fd, &st) == -1) {
+		close(fd);
+		return -1;
+	}
+	f->size = st.st_size;
+	if (f->size > 0) {
+		f->base = mmap(NULL, f->size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (f->base == MAP_FAILED) {
+			close(fd);
+			return -1;
+		}
+		madvise((void*) f->base, f->size, MADV_SEQUENTIAL);
+	}
+	close(fd);
+	if (read_index(path, f) == -1) {
+		free(f->blocks);
+		f->blocks = NULL;
+		f->nblocks = 0;
+		if (walk_blocks(f) == -1) {
+			gr_unmap(f);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+void gr_unmap(struct gr_file* f)
+{
+	if (f->size > 0 && f->base != NULL)
+		munmap((void*) f->base, f->size);
+	free(f->blocks);
+	memset(f, 0, sizeof(*f));
+}
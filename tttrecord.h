@@ -0,0 +1,99 @@
+/******************************************************************************
+  Title          : tttrecord.h
+  Author         : Andriy Goltsev
+  Description    : Compact append-only records of the games played
+
+  Notes          : A game record is GR_GAME_BYTES of settings followed by
+                   the cells played, client first, packed in as few bits as
+                   the board needs (4 on the classic board, 8 on 16x16):
+
+                       byte 0   (rows - 1) << 4 | (cols - 1)
+                       byte 1   k
+                       byte 2   level
+                       byte 3   result | engine << 2, the result being
+                                TIED, CLIENT_WINS or SERVER_WINS (ttt.h),
+                                or STATUS_OK if the session ended first
+                       byte 4-5 number of moves, little-endian
+                       then the cells, bit 0 of each byte first
+
+                   Each server process collects records in a buffer of
+                   GR_BLOCK_BYTES and appends it to the file as one block,
+                   a struct gr_block and the records, with a single write()
+                   when the buffer is full, when a session ends and when
+                   the server exits. Blocks of different processes never
+                   mix, since every process opens the file itself with
+                   O_APPEND. After each block an entry giving its offset is
+                   appended to path.idx, the index of the file; a reader
+                   that finds no index walks the blocks from the start.
+
+******************************************************************************/
+
+#ifndef TTTRECORD_H
+#define TTTRECORD_H
+
+#include <stdint.h>
+#include "tttgame.h"
+
+#define GR_MAGIC	"TTGR"
+#define GR_GAME_BYTES	6
+#define GR_BLOCK_BYTES	65536		// records of one block, at most
+#define GR_MAX_RECORD	(GR_GAME_BYTES + TG_MAX_CELLS)
+
+struct gr_block {
+	char magic[4];		// GR_MAGIC
+	uint32_t bytes;		// of the records after the header
+	uint32_t games;
+	uint32_t pid;		// of the server process that wrote it
+	uint64_t ns;		// CLOCK_REALTIME when it was written
+};
+
+struct gr_index {
+	uint64_t offset;	// of the struct gr_block in the file
+	uint32_t bytes;		// the block's bytes
+	uint32_t games;
+	uint64_t ns;
+};
+
+// a decoded game record
+struct gr_game {
+	int rows, cols, k;
+	int level, engine;
+	int result;		// TIED, CLIENT_WINS, SERVER_WINS or STATUS_OK
+	int moves;
+	unsigned char cell[TG_MAX_CELLS];	// row * cols + col, client first
+};
+
+// a record file mapped for reading
+struct gr_file {
+	const unsigned char* base;
+	long size;
+	struct gr_index* blocks;	// from path.idx or found by a walk
+	int nblocks;
+};
+
+extern int gr_recording;		// gr_init() succeeded
+
+//turns recording on; records go to path, which is checked here. Returns -1
+//with errno set
+int gr_init(const char* path);
+
+static inline int gr_on(void)
+{
+	return gr_recording;
+}
+
+//adds the game to the buffer of this process with its result
+void gr_add(const struct ttt_game* game, int result);
+
+//writes the buffer of this process as one block
+void gr_flush(void);
+
+//maps the file at path and finds its blocks; returns 0 or -1 with errno set
+int gr_map(const char* path, struct gr_file* f);
+
+void gr_unmap(struct gr_file* f);
+
+//decodes the record at p, at most end - p bytes; returns its length or -1
+int gr_decode(const unsigned char* p, const unsigned char* end, struct gr_game* g);
+
+#endif
@@ -0,0 +1,230 @@
+/******************************************************************************
+  Title          : tttring.c
+  Author         : Andriy Goltsev
+  Description    : SPSC rings of struct move in a memfd, eventfd wakeups
+
+  Notes          : head and tail only grow; a slot is head % TR_SLOTS. The
+                   producer publishes a slot with a release store of head,
+                   the consumer frees it with a release store of tail. The
+                   sleeping flag and the indexes are accessed sequentially
+                   consistent around a sleep, so that either the producer
+                   sees the flag or the consumer sees the new move. There is
+                   no spinning on a single CPU.
+                   The memfd comes sealed against shrinking and growing, so
+                   the server's mapping stays valid whatever the client
+                   does with its end: a ring it could truncate would kill
+                   the server with SIGBUS on the next access. For the same
+                   reason the bells must be eventfds, which the server
+                   makes non-blocking; the client shares that flag.
+
+******************************************************************************/
+
+#define _GNU_SOURCE	// memfd_create()
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/eventfd.h>
+#include "tttring.h"
+#include "tttproto.h"
+#include "tttsock.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define cpu_relax()	__builtin_ia32_pause()
+#else
+#define cpu_relax()	((void) 0)
+#endif
+
+#define TR_SEALS	(F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL)
+
+//the bells do not block: EAGAIN means the count is full, which wakes the
+//other side as well as one more would
+static void ring_bell(int fd)
+{
+	uint64_t one = 1;
+
+	while (write(fd, &one, sizeof(one)) == -1 && errno == EINTR)
+		;
+}
+
+//1 if fd is an eventfd: an anonymous inode, which /proc names after its kind
+static int is_eventfd(int fd)
+{
+	char path[32], link[sizeof("anon_inode:[eventfd]")];
+	struct stat st;
+	ssize_t n;
+
+	if (fstat(fd, &st) == -1 || (st.st_mode & S_IFMT) != 0)
+		return 0;
+	snprintf(path, sizeof(path), "/proc/self/fd/%d", fd);
+	n = readlink(path, link, sizeof(link));
+	return n == sizeof(link) - 1 && memcmp(link, "anon_inode:[eventfd]", n) == 0;
+}
+
+static int set_nonblocking(int fd)
+{
+	int flags = fcntl(fd, F_GETFL);
+
+	return flags == -1 ? -1 : fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+//points e at the channel; server is 1 on the server's side
+static int map_channel(struct tr_end* e, int server)
+{
+	void* p;
+
+	p = mmap(NULL, sizeof(struct tr_channel), PROT_READ | PROT_WRITE, MAP_SHARED, e->fds[0], 0);
+	if (p == MAP_FAILED)
+		return -1;
+	e->ch = p;
+	e->in = server ? &e->ch->up : &e->ch->down;
+	e->out = server ? &e->ch->down : &e->ch->up;
+	e->in_bell = e->fds[server ? 1 : 2];
+	e->out_bell = e->fds[server ? 2 : 1];
+	return 0;
+}
+
+int tr_connect(int sock, const struct handshake* hndshk, struct tr_end* e)
+{
+	unsigned char hello[TP_MAX_FRAME];
+	int len;
+
+	memset(e, 0, sizeof(*e));
+	e->fds[1] = e->fds[2] = -1;
+	e->fds[0] = memfd_create("ttt-ring", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	e->fds[1] = eventfd(0, EFD_CLOEXEC);	// wakes the server
+	e->fds[2] = eventfd(0, EFD_CLOEXEC);	// wakes the client
+	if (e->fds[0] == -1 || e->fds[1] == -1 || e->fds[2] == -1 ||
+	    ftruncate(e->fds[0], sizeof(struct tr_channel)) == -1 ||
+	    fcntl(e->fds[0], F_ADD_SEALS, TR_SEALS) == -1 ||
+	    map_channel(e, 0) == -1) {
+		tr_close(e);
+		return -1;
+	}
+	len = tp_put_hello(hello, hndshk);
+	if (us_send_fds(sock, hello, len, e->fds, 3) != len) {
+		tr_close(e);
+		return -1;
+	}
+	return 0;
+}
+
+int tr_attach(struct tr_end* e, const int fds[3])
+{
+	struct stat st;
+	int seals;
+
+	memset(e, 0, sizeof(*e));
+	memcpy(e->fds, fds, sizeof(e->fds));
+	// the segment must be big enough to hold the channel before it is
+	// touched, and sealed so that it stays so. The bells must be eventfds
+	// that never block: a pipe, or an eventfd the client filled up, would
+	// stop the server on the next reply
+	if (e->fds[0] == -1 || e->fds[1] == -1 || e->fds[2] == -1 ||
+	    (seals = fcntl(e->fds[0], F_GET_SEALS)) == -1 || (seals & TR_SEALS) != TR_SEALS ||
+	    fstat(e->fds[0], &st) == -1 || st.st_size < (off_t) sizeof(struct tr_channel) ||
+	    !is_eventfd(e->fds[1]) || !is_eventfd(e->fds[2]) ||
+	    set_nonblocking(e->fds[1]) == -1 || set_nonblocking(e->fds[2]) == -1 ||
+	    map_channel(e, 1) == -1) {
+		tr_close(e);
+		return -1;
+	}
+	return 0;
+}
+
+int tr_push(struct tr_end* e, const struct move* mv)
+{
+	struct tr_ring* r = e->out;
+	unsigned head = atomic_load_explicit(&r->head, memory_order_relaxed);
+
+	if (head - atomic_load_explicit(&r->tail, memory_order_acquire) == TR_SLOTS)
+		return -1;
+	r->slot[head % TR_SLOTS] = *mv;
+	atomic_store(&r->head, head + 1);
+	if (atomic_load(&r->sleeping) && atomic_exchange(&r->sleeping, 0))
+		ring_bell(e->out_bell);
+	return 0;
+}
+
+int tr_pop(struct tr_end* e, struct move* mv)
+{
+	struct tr_ring* r = e->in;
+	unsigned tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+
+	if (tail == atomic_load_explicit(&r->head, memory_order_acquire))
+		return 0;
+	*mv = r->slot[tail % TR_SLOTS];
+	atomic_store_explicit(&r->tail, tail + 1, memory_order_release);
+	return 1;
+}
+
+int tr_sleep(struct tr_end* e)
+{
+	struct tr_ring* r = e->in;
+
+	atomic_store(&r->sleeping, 1);
+	if (atomic_load(&r->head) != atomic_load_explicit(&r->tail, memory_order_relaxed)) {
+		atomic_store(&r->sleeping, 0);
+		return 1;
+	}
+	return 0;
+}
+
+void tr_woken(struct tr_end* e)
+{
+	uint64_t count;
+
+	while (read(e->in_bell, &count, sizeof(count)) == -1 && errno == EINTR)
+		;
+}
+
+void tr_rewake(struct tr_end* e)
+{
+	ring_bell(e->in_bell);
+}
+
+int tr_wait(struct tr_end* e, struct move* mv, int watch)
+{
+	static int spins = -1;
+	struct pollfd fds[2];
+	int i;
+
+	// on a single CPU the peer cannot run while this side spins
+	if (spins == -1)
+		spins = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? TR_SPINS : 0;
+	for (;;) {
+		for (i = 0; i < spins; i++) {
+			if (tr_pop(e, mv))
+				return 1;
+			cpu_relax();
+		}
+		if (tr_pop(e, mv))
+			return 1;
+		if (tr_sleep(e))
+			continue;
+		fds[0].fd = e->in_bell;
+		fds[1].fd = watch;
+		fds[0].events = fds[1].events = POLLIN;
+		if (poll(fds, 2, -1) == -1 && errno != EINTR)
+			return 0;
+		if (fds[0].revents & POLLIN)
+			tr_woken(e);
+		else if (fds[1].revents & (POLLIN | POLLHUP | POLLERR))
+			return tr_pop(e, mv);	// nothing is sent on the socket but EOF
+	}
+}
+
+void tr_close(struct tr_end* e)
+{
+	int i;
+
+	if (e->ch != NULL)
+		munmap(e->ch, sizeof(struct tr_channel));
+	e->ch = NULL;
+	for (i = 0; i < 3; i++)
+		if (e->fds[i] != -1)
+			close(e->fds[i]);
+	e->fds[0] = e->fds[1] = e->fds[2] = -1;
+}
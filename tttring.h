@@ -0,0 +1,90 @@
+/******************************************************************************
+  Title          : tttring.h
+  Author         : Andriy Goltsev
+  Description    : Shared-memory ring transport for clients on the same host
+
+  Notes          : Meant for bots. A client connects to the Unix socket
+                   (tttsock.h) and sends its hello (tttproto.h) with
+                   transport set to TRANSPORT_RING, passing along
+                   (SCM_RIGHTS) a memfd, sealed against resizing, that
+                   holds two single-producer single-consumer rings of
+                   struct move, one per direction, and one eventfd per
+                   direction. Moves are then exchanged through the shared
+                   memory only. A consumer spins for a while on an empty
+                   ring and then sleeps on its eventfd; the producer writes
+                   to the eventfd only when it finds the consumer asleep, so
+                   a busy pair of players makes no system calls at all.
+                   The server's welcome comes on the socket, which then
+                   stays open only so that each side sees the other go
+                   away.
+
+******************************************************************************/
+
+#ifndef TTTRING_H
+#define TTTRING_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include "ttt.h"
+
+#define TR_SLOTS	64	// moves per ring, a power of 2
+#define TR_SPINS	4096	// polls of an empty ring before sleeping
+#define TR_CACHE_LINE	64
+
+struct tr_ring {
+	_Alignas(TR_CACHE_LINE) atomic_uint head;	// next slot written, by the producer
+	_Alignas(TR_CACHE_LINE) atomic_uint tail;	// next slot read, by the consumer
+	atomic_int sleeping;				// the consumer waits on its eventfd
+	_Alignas(TR_CACHE_LINE) struct move slot[TR_SLOTS];
+};
+
+// the shared segment
+struct tr_channel {
+	struct tr_ring up;	// client to server
+	struct tr_ring down;	// server to client
+};
+
+// one side's view of a channel
+struct tr_end {
+	struct tr_channel* ch;
+	struct tr_ring* in;	// ring this side consumes
+	struct tr_ring* out;	// ring this side produces
+	int in_bell;		// eventfd that wakes this side
+	int out_bell;		// eventfd that wakes the other side
+	int fds[3];		// memfd and the two eventfds, as passed on the socket
+};
+
+//client: creates the channel and sends the hello of hndshk with it on the
+//connected socket sock; returns 0 or -1
+int tr_connect(int sock, const struct handshake* hndshk, struct tr_end* e);
+
+//server: maps the channel passed with a hello (memfd, server's eventfd,
+//client's eventfd) into e and makes the bells non-blocking; returns 0, or -1
+//after closing fds if they are not a sealed memfd and two eventfds
+int tr_attach(struct tr_end* e, const int fds[3]);
+
+//queues mv for the other side; returns 0 or -1 if the ring is full
+int tr_push(struct tr_end* e, const struct move* mv);
+
+//takes the next move without waiting; returns 1 if there was one, 0 if not
+int tr_pop(struct tr_end* e, struct move* mv);
+
+//marks this side asleep; returns 0 if the ring is still empty and the caller
+//should wait on in_bell, 1 if a move arrived in the meantime
+int tr_sleep(struct tr_end* e);
+
+//empties in_bell after a wakeup
+void tr_woken(struct tr_end* e);
+
+//rings this side's own bell, so that an event loop that left moves on the
+//ring comes back to them
+void tr_rewake(struct tr_end* e);
+
+//waits for the next move, spinning first and then sleeping; returns 1 with
+//a move or 0 once watch (the socket) reports the peer gone
+int tr_wait(struct tr_end* e, struct move* mv, int watch);
+
+//unmaps the channel and closes its descriptors
+void tr_close(struct tr_end* e);
+
+#endif
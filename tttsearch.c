@@ -0,0 +1,248 @@
+/******************************************************************************
+  Title          : tttsearch.c
+  Author         : Andriy Goltsev
+  Description    : Negamax search with alpha-beta pruning for the TTT server
+
+  Notes          : Scores are from the point of view of the side to move.
+                   A win is worth TS_WIN plus the number of cells still empty,
+                   so that the search prefers quick wins and slow losses.
+                   Moves are ordered as: forced blocks first, then the centre,
+                   the corners and the edges, with the transposition table's
+                   move for the position tried before all of them. With that
+                   order the full game tree from any position is searched in
+                   a few hundred nodes.
+
+                   A depth limited result is only reused for the same depth
+                   (or a complete search), otherwise a weak level would pick
+                   up the perfect answers of the warm-up.
+
+******************************************************************************/
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <limits.h>
+#include "tttsearch.h"
+#include "ttthash.h"
+
+#define TS_INF	(TS_WIN + TB_CELLS)
+
+// static move order: centre, corners, edges
+static const int _order[TB_CELLS] = { 4, 0, 2, 6, 8, 1, 3, 5, 7 };
+
+//fills moves[] with the empty cells of b in search order, returns their count
+static int order_moves(const struct ttt_board* b, int side, int* moves)
+{
+	ttt_mask empty = tb_legal(b);
+	ttt_mask threats = 0;
+	int i, cell, n = 0;
+
+	// cells where the opponent would complete a line must be looked at first
+	for (i = 0; i < TB_CELLS; i++) {
+		cell = _order[i];
+		if ((empty & TB_BIT(cell)) && tb_has_line(b->side[!side] | TB_BIT(cell))) {
+			threats |= TB_BIT(cell);
+			moves[n++] = cell;
+		}
+	}
+	for (i = 0; i < TB_CELLS; i++) {
+		cell = _order[i];
+		if ((empty & ~threats) & TB_BIT(cell))
+			moves[n++] = cell;
+	}
+	return n;
+}
+
+//returns a cell where side completes a line, or TB_NO_CELL
+static int winning_cell(const struct ttt_board* b, int side)
+{
+	ttt_mask empty = tb_legal(b);
+	int cell;
+
+	while (empty) {
+		cell = tb_first(empty);
+		if (tb_has_line(b->side[side] | TB_BIT(cell)))
+			return cell;
+		empty &= empty - 1;
+	}
+	return TB_NO_CELL;
+}
+
+//moves cell to the front of moves[], keeping the order of the others
+static void move_to_front(int* moves, int n, int cell)
+{
+	int i;
+
+	for (i = 0; i < n && moves[i] != cell; i++)
+		;
+	if (i == n)
+		return;
+	for (; i > 0; i--)
+		moves[i] = moves[i - 1];
+	moves[0] = cell;
+}
+
+static int negamax(struct ttt_board* b, int side, int depth, int alpha, int beta)
+{
+	int moves[TB_CELLS];
+	int i, n, score, best, best_move, flag;
+	int alpha0 = alpha;
+	int empty = tb_count(tb_legal(b));
+	const struct th_entry* e;
+	struct th_pos pos;
+
+	if (empty == 0 || depth == 0)
+		return 0;
+	if (winning_cell(b, side) != TB_NO_CELL)
+		return TS_WIN + empty - 1;
+	if (depth > empty)
+		depth = empty;	// searching past the end of the game changes nothing
+
+	n = order_moves(b, side, moves);
+	th_canonical(b->side[side], b->side[!side], &pos);
+	if ((e = th_probe(pos.key)) != NULL && e->depth == depth) {
+		if (e->flag == TH_EXACT)
+			return e->value;
+		if (e->flag == TH_LOWER && e->value > alpha)
+			alpha = e->value;
+		else if (e->flag == TH_UPPER && e->value < beta)
+			beta = e->value;
+		if (alpha >= beta)
+			return e->value;
+		move_to_front(moves, n, th_from_canonical(pos.sym, e->move));
+	}
+
+	best = -TS_INF;
+	best_move = moves[0];
+	for (i = 0; i < n; i++) {
+		tb_apply(b, side, moves[i]);
+		score = -negamax(b, !side, depth - 1, -beta, -alpha);
+		tb_undo(b, side, moves[i]);
+		if (score > best) {
+			best = score;
+			best_move = moves[i];
+			if (best > alpha)
+				alpha = best;
+			if (alpha >= beta)
+				break;
+		}
+	}
+
+	if (best <= alpha0)
+		flag = TH_UPPER;
+	else if (best >= beta)
+		flag = TH_LOWER;
+	else
+		flag = TH_EXACT;
+	th_store(pos.key, best, depth, flag, th_to_canonical(pos.sym, best_move));
+	return best;
+}
+
+int ts_value(struct ttt_board* b, int side)
+{
+	th_init();
+	return negamax(b, side, TS_LEVEL_PERFECT, -TS_INF, TS_INF);
+}
+
+int ts_best_move(struct ttt_board* b, int side, int level)
+{
+	int moves[TB_CELLS];
+	int i, n, score, best, alpha, empty;
+	const struct th_entry* e;
+	struct th_pos pos;
+
+	if (tb_is_full(b))
+		return TB_NO_CELL;
+	if (level <= TS_LEVEL_FIRST_EMPTY)
+		return tb_first(tb_legal(b));
+	if ((best = winning_cell(b, side)) != TB_NO_CELL)
+		return best;
+	empty = tb_count(tb_legal(b));
+	if (level > empty)
+		level = empty;
+
+	th_init();
+	th_canonical(b->side[side], b->side[!side], &pos);
+	if ((e = th_probe(pos.key)) != NULL && e->depth == level && e->flag == TH_EXACT)
+		return th_from_canonical(pos.sym, e->move);
+
+	n = order_moves(b, side, moves);
+	best = moves[0];
+	alpha = -TS_INF;
+	for (i = 0; i < n; i++) {
+		tb_apply(b, side, moves[i]);
+		score = -negamax(b, !side, level - 1, -TS_INF, -alpha);
+		tb_undo(b, side, moves[i]);
+		if (score > alpha) {
+			alpha = score;
+			best = moves[i];
+		}
+	}
+	th_store(pos.key, alpha, level, TH_EXACT, th_to_canonical(pos.sym, best));
+	return best;
+}
+
+int ts_grid_move(const struct ttt_grid* g, int side, int level)
+{
+	struct ttt_board b;
+	int cell, r, c, dist;
+	int block = TB_NO_CELL, best = TB_NO_CELL, best_dist = INT_MAX;
+
+	if (tg_is_full(g))
+		return TB_NO_CELL;
+	if (tg_is_classic(g)) {
+		b = tg_classic(g);
+		return ts_best_move(&b, side, level);
+	}
+	if (level <= TS_LEVEL_FIRST_EMPTY)
+		return tg_next_empty(g, 0);
+
+	for (cell = tg_next_empty(g, 0); cell != TB_NO_CELL; cell = tg_next_empty(g, cell + 1)) {
+		if (tg_makes_line(g, side, cell))
+			return cell;
+		if (block == TB_NO_CELL && tg_makes_line(g, !side, cell))
+			block = cell;
+		r = cell / g->cols;
+		c = cell % g->cols;
+		dist = abs(2 * r - (g->rows - 1)) + abs(2 * c - (g->cols - 1));
+		if (dist < best_dist) {
+			best_dist = dist;
+			best = cell;
+		}
+	}
+	return block != TB_NO_CELL ? block : best;
+}
+
+//visits every position where side is to move after the opponent's reply
+static void warm(struct ttt_board* b, int side, int level)
+{
+	ttt_mask theirs = tb_legal(b), mine;
+	int cell, reply;
+
+	while (theirs) {
+		cell = tb_first(theirs);
+		theirs &= theirs - 1;
+		tb_apply(b, !side, cell);
+		if (!tb_has_line(b->side[!side]) && !tb_is_full(b)) {
+			ts_best_move(b, side, level);
+			mine = tb_legal(b);
+			while (mine) {
+				reply = tb_first(mine);
+				mine &= mine - 1;
+				tb_apply(b, side, reply);
+				if (!tb_has_line(b->side[side]) && !tb_is_full(b))
+					warm(b, side, level);
+				tb_undo(b, side, reply);
+			}
+		}
+		tb_undo(b, !side, cell);
+	}
+}
+
+void ts_warm(int side, int level)
+{
+	struct ttt_board b;
+
+	th_init();
+	tb_clear(&b);
+	warm(&b, side, level);
+}
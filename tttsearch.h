@@ -0,0 +1,41 @@
+/******************************************************************************
+  Title          : tttsearch.h
+  Author         : Andriy Goltsev
+  Description    : Move search for the server side of the TTT game
+
+  Notes          : The search is a negamax with alpha-beta pruning over the
+                   bitboard in tttboard.h. The strength level is the number
+                   of plies the server looks ahead; TS_LEVEL_PERFECT searches
+                   the game to the end and never loses. Level 0 keeps the
+                   original behaviour of taking the first empty cell.
+                   Results are cached in the transposition table (ttthash.h).
+
+******************************************************************************/
+
+#ifndef TTTSEARCH_H
+#define TTTSEARCH_H
+
+#include "tttboard.h"
+#include "tttgrid.h"
+
+#define TS_LEVEL_FIRST_EMPTY	0
+#define TS_LEVEL_PERFECT	TB_CELLS
+
+#define TS_WIN	100	// score of a win, the number of empty cells left is added
+
+//returns the cell side should play on b, or TB_NO_CELL if the board is full
+int ts_best_move(struct ttt_board* b, int side, int level);
+
+//negamax value of b with side to move, searched to the end of the game
+int ts_value(struct ttt_board* b, int side);
+
+//returns the cell side should play on any grid, or TB_NO_CELL if it is full;
+//3x3 three-in-a-row is searched with ts_best_move(), larger boards take a
+//winning cell, a blocking cell or the empty cell closest to the centre
+int ts_grid_move(const struct ttt_grid* g, int side, int level);
+
+//fills the transposition table with the answer of side at level for every
+//position that can come up when the opponent moves first
+void ts_warm(int side, int level);
+
+#endif
@@ -9,9 +9,53 @@
                    (requires ttt.h header file)
 
   Usage          : Start this server first using the command 
-                   tttclient
+                   tttserver [-b bookfile] [-t msec] [-j threads] [-m megabytes]
+                             [-M megabytes] [-e] [-w workers] [-p] [-i seconds]
+                             [-d seconds] [-S sessions] [-Q clients] [-u rate]
+                             [-l logfile] [-r megabytes] [-g gamefile]
                    Then start up any client as a foreground process.
                    Server will play TTT game with client.
+                   -b names the perfect-play book written by tttgen
+                   (ttt.book in the current directory by default). Without
+                   a book the server searches every position at startup.
+                   -t is the time budget of one server move on boards
+                   larger than 3x3 (TD_BUDGET_MS by default) and -j the
+                   number of threads each game may search with (1 by
+                   default). -m caps the tree of a game played with the
+                   MCTS engine (TM_ARENA_BYTES by default); its peak size
+                   is logged to syslog when the game ends. -M caps the
+                   trees of all the games of a session (TTT_SESSION_ARENA
+                   by default); games past it use the search engine.
+                   -e serves every client from a single process instead of
+                   forking one per client (see tttevent.h). -w forks that
+                   many workers at startup (one per CPU if 0), each running
+                   the event loop over many clients, and hands every new
+                   client to the least loaded one (see tttpool.h); -p pins
+                   each worker to a CPU of its own.
+                   A session that sends no move for -i seconds (600 by
+                   default) or lasts longer than -d seconds (a day) is
+                   ended, 0 meaning no limit; the server reaps its
+                   children, accounts their CPU time and memory and
+                   removes the FIFOs crashed clients leave in /tmp (see
+                   tttsuper.h).
+                   -S caps the sessions running at once; up to -Q more
+                   clients (128 by default) wait for one to end, and -u
+                   caps the sessions each user may start per second. A
+                   client turned away is told SERVER_BUSY (tttadmit.h).
+                   Besides the public FIFO, the server listens on the Unix
+                   socket SOCKET_PATH (see tttsock.h); either way of
+                   connecting may be used by any client. Bots on the socket
+                   may also exchange moves through shared memory instead
+                   (see tttring.h).
+                   The server counts handshakes, games, moves and outcomes
+                   and times handshakes, moves and replies (tttstats.h);
+                   tttstat prints the totals, which are served on
+                   STATS_PATH, at any time.
+                   -l turns on the binary event log (tttlog.h) in the given
+                   file, which is rotated when it reaches -r megabytes
+                   (64 by default); tttlogcat prints it. -g appends a
+                   compact record of every game to gamefile (tttrecord.h)
+                   for tttgames to replay and analyze.
                    
 
                    
@@ -26,18 +70,37 @@
                    write to that pipe.
           
                    The server forks a process for each client that makes a
-                   connection.
+                   connection, unless it runs with -e or -w.
 
-                   The server uses a waitpid() loop inside its SIGCHLD
-                   handler to collect its zombie processes.
+                   The SIGCHLD handler only notes that children exited;
+                   the main loop collects them with wait4() (tttsuper.h).
 		   
-                   The server does not maintain any log file.
+                   The server does not maintain any log file; see tttstats.h
+                   for its counters.
   
  Based on	: upcased2.c written by Stewart Weiss                  
  
 ******************************************************************************/
 
 #include "ttt.h"   
+#include "tttgame.h"
+#include "tttsearch.h"
+#include "ttthash.h"
+#include "tttbook.h"
+#include "tttdeep.h"
+#include "tttevent.h"
+#include "tttpool.h"
+#include "tttsuper.h"
+#include "tttadmit.h"
+#include "tttsock.h"
+#include "tttring.h"
+#include "tttproto.h"
+#include "tttstats.h"
+#include "tttlog.h"
+#include "tttrecord.h"
+#include <syslog.h>
+#include <poll.h>
+#include <sys/socket.h>
 #include "sys/wait.h"  
 
 #define  WARNING  "\nNOTE: SERVER ** NEVER ** accessed private FIFO\n"
@@ -49,10 +112,15 @@ int            dummyfifo;        // file descriptor to write-end of PUBLIC
 int            clientreadfifo;   // file descriptor to write-end of PRIVATE
 int            clientwritefifo;  // file descriptor to write-end of PRIVATE
 int            publicfifo;       // file descriptor to read-end of PUBLIC
-FILE*          tttlog;        // points to log file for server
+int            listensock = -1;  // Unix socket at SOCKET_PATH, see tttsock.h
+int            statsock = -1;    // Unix socket at STATS_PATH, see tttstats.h
 
-ttt_type _board[BOARD_SIZE][BOARD_SIZE]; //t-t-t matrix
-int _server_char, _client_char;
+int            _event_mode;      // serve all clients from one process (-e)
+int            _workers = -1;    // pre-forked event-loop workers (-w), 0: one per CPU
+int            _pin;             // pin the workers to CPUs (-p)
+int            _movefd = -1;     // a child's, for on_expire()
+int            _devnull = -1;    // /dev/null, put over _movefd by on_expire()
+int            _live;            // children serving a session
 
 
 /*****************************************************************************/
@@ -65,23 +133,36 @@ void on_sigchld( int signo );
 
 void on_signal( int sig );
 
+void on_expire( int sig );
+
 //daemonizes the server
 void daemon_init(const char* , int );
 
-//initializes new forked process
-void init_new_game(const struct handshake* hndshk);
+//plays one client's game: moves are read from movefd through r, replies go
+//to replyfd. With a ring the moves travel on it and movefd only tells when
+//the client is gone. since is when the hello arrived (st_now())
+void play_session(const struct handshake* hndshk, struct tp_reader* r,
+                  int movefd, int replyfd, struct tr_end* ring, long long since);
+
+//opens the session of a client connected to the Unix socket at since
+void socket_session(int sock, long long since);
 
-//returns the status of the game: TIED, USER_WINS etc. See ttt.h
-int ttt_status();
+//starts, queues or turns away a new client (tttadmit.h)
+void admit(struct ad_client* client);
 
-//counter attacks the user
-void counterAttack(struct move* new_move);
+//forks a child for the session of an admitted client
+void start_client(const struct ad_client* client);
 
-//return STATUS_OK if the move is valid
-int validMove(struct move* client_mv);
+//closes the listening sockets in a child
+void close_listeners(void);
 
-//given client_mv sets up server_mv 
-void ttt_play(struct move* client_mv, struct move* server_mv);
+//sets up a child forked for one client; slot is its place in the
+//supervisor's table (tttsuper.h), or NULL
+void start_child(struct sv_child* slot);
+
+//removes the public FIFO and the sockets, flushes the records and exits;
+//called by the main loop once on_signal() has set sv_stopping
+void stop_server(void);
 
 /*****************************************************************************/
 /*                              Main Program                                 */
@@ -92,13 +173,123 @@ int main( int argc, char *argv[])
      
     
                             
-    int              tries;           // num tries to open private FIFO
-    int              nbytes;          // number of bytes read from popen() 
-    int              i;
-    struct handshake   handshk;             // stores private fifo name and command
+    struct pollfd    fds[3];          // public FIFO, listening and stats sockets
+    static struct tp_reader hellos;   // frames read from the public FIFO
+    const unsigned char* frame;
+    int              len;
+    struct ad_client client;          // a new client, see tttadmit.h
     struct sigaction handler;         // sigaction for registering handlers
     char             buffer[PIPE_BUF];
+    int              opt;
+    const char*      book = NULL;     // perfect-play table from tttgen
+    const char*      log = NULL;      // event log, see tttlog.h
+    const char*      games = NULL;    // game records, see tttrecord.h
+    long             rotate = LG_ROTATE_BYTES;
+    int              ready;
     
+    while ( (opt = getopt(argc, argv, "b:t:j:m:M:ew:pi:d:S:Q:u:l:r:g:")) != -1 ) {
+        switch (opt) {
+            case 'b':
+                book = optarg;
+                break;
+            case 't':
+                if ( (ttt_budget_ms = atol(optarg)) <= 0 ) {
+                    fprintf(stderr, "%s: the time budget must be positive\n", argv[0]);
+                    exit(1);
+                }
+                break;
+            case 'j':
+                td_set_threads(atoi(optarg));
+                break;
+            case 'm':
+                if ( atol(optarg) <= 0 ) {
+                    fprintf(stderr, "%s: the tree size must be positive\n", argv[0]);
+                    exit(1);
+                }
+                tm_set_arena_limit((size_t) atol(optarg) << 20);
+                break;
+            case 'M':
+                if ( atol(optarg) < 0 ) {
+                    fprintf(stderr, "%s: the trees of a session cannot be negative\n", argv[0]);
+                    exit(1);
+                }
+                ttt_session_arena = (size_t) atol(optarg) << 20;
+                break;
+            case 'e':
+                _event_mode = 1;
+                break;
+            case 'w':
+                if ( (_workers = atoi(optarg)) < 0 || _workers > WP_MAX_WORKERS ) {
+                    fprintf(stderr, "%s: 0 to %d workers\n", argv[0], WP_MAX_WORKERS);
+                    exit(1);
+                }
+                break;
+            case 'p':
+                _pin = 1;
+                break;
+            case 'i':
+            case 'd':
+                if ( atol(optarg) < 0 ) {
+                    fprintf(stderr, "%s: a time limit cannot be negative\n", argv[0]);
+                    exit(1);
+                }
+                *(opt == 'i' ? &sv_idle_ms : &sv_session_ms) = atol(optarg) * 1000L;
+                break;
+            case 'S':
+            case 'Q':
+                if ( atoi(optarg) < 0 ) {
+                    fprintf(stderr, "%s: a limit cannot be negative\n", argv[0]);
+                    exit(1);
+                }
+                *(opt == 'S' ? &ad_max_sessions : &ad_queue_max) = atoi(optarg);
+                break;
+            case 'u':
+                if ( (ad_uid_rate = atof(optarg)) < 0 ) {
+                    fprintf(stderr, "%s: a rate cannot be negative\n", argv[0]);
+                    exit(1);
+                }
+                break;
+            case 'l':
+                log = optarg;
+                break;
+            case 'g':
+                games = optarg;
+                break;
+            case 'r':
+                if ( (rotate = atol(optarg) << 20) <= 0 ) {
+                    fprintf(stderr, "%s: the log size must be positive\n", argv[0]);
+                    exit(1);
+                }
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-b bookfile] [-t msec] [-j threads] [-m megabytes]\n"
+                        "       [-M megabytes] [-e] [-w workers] [-p] [-i seconds] [-d seconds] [-S sessions]\n"
+                        "       [-Q clients] [-u rate] [-l logfile] [-r megabytes] [-g gamefile]\n", argv[0]);
+                exit(1);
+        }
+    }
+
+    // Map the book before daemon_init() changes directory. A missing
+    // default book is not an error, the server then warms its search.
+    if ( bk_open(book ? book : BK_DEFAULT) == -1 && book ) {
+        perror(book);
+        exit(1);
+    }
+
+    // The rings of the event log are shared with the children; the file is
+    // checked here, while errors still reach the terminal
+    if ( log && lg_init(log, rotate) == -1 ) {
+        perror(log);
+        exit(1);
+    }
+    if ( games && gr_init(games) == -1 ) {
+        perror(games);
+        exit(1);
+    }
+    if ( ad_init() == -1 ) {
+        perror("admission queue");
+        exit(1);
+    }
 
     // Try to create public FIFO, if it exists, the server might be already running 
     if ( mkfifo(PUBLIC, 0666) < 0 ) {
@@ -112,7 +303,19 @@ int main( int argc, char *argv[])
     }
 
     //make it a daemon 
-    daemon_init(argv[0], 0);
+    daemon_init(argv[0], LOG_DAEMON);
+
+    // Without a book, search every position once before forking; the
+    // children then share the table read-only and answer perfect play
+    // with a single lookup
+    if ( !bk_loaded() )
+        ts_warm(TB_SERVER, TS_LEVEL_PERFECT);
+    th_freeze();
+
+    if ( log && lg_start() == -1 ) {
+        syslog(LOG_ERR, "%s: %m", log);
+        exit(1);
+    }
 
     // Register the signal handler 
     handler.sa_handler = on_signal;  
@@ -142,77 +345,292 @@ int main( int argc, char *argv[])
     // Open public FIFO for reading and writing so that it does not get an
     // EOF on the read-end while waiting for a client to send data.
     // To prevent it from hanging on the open, the write-end is opened in 
-    // non-blocking mode. It never writes to it.
-    if ( (publicfifo = open(PUBLIC, O_RDONLY) ) == -1 ||
-         ( dummyfifo = open(PUBLIC, O_WRONLY | O_NDELAY )) == -1  ) {
+    // non-blocking mode. It never writes to it. The read-end is opened
+    // in non-blocking mode too, so that socket clients are served before
+    // the first FIFO client shows up, and is made blocking afterwards.
+    if ( (publicfifo = open(PUBLIC, O_RDONLY | O_NDELAY) ) == -1 ||
+         ( dummyfifo = open(PUBLIC, O_WRONLY | O_NDELAY )) == -1 ||
+         fcntl(publicfifo, F_SETFL, fcntl(publicfifo, F_GETFL) & ~O_NDELAY) == -1 ) {
         //perror(PUBLIC);
         exit(1);
     }
 
-    // Block waiting for a handshake struct from a client
-    while ( read( publicfifo, (char*) &handshk, sizeof(handshk)) > 0 ) {
+    // Clients on this host may connect to a Unix socket instead of
+    // sending their handshake through the public FIFO
+    if ( (listensock = us_listen(SOCKET_PATH)) == -1 )
+        syslog(LOG_WARNING, "%s: %m, serving FIFO clients only", SOCKET_PATH);
+
+    // The counters are shared with the children, so they are mapped first
+    if ( st_init() == -1 ||
+         (statsock = us_listen(STATS_PATH)) == -1 ||
+         fcntl(statsock, F_SETFL, fcntl(statsock, F_GETFL) | O_NONBLOCK) == -1 )
+        syslog(LOG_WARNING, "%s: %m, no stats", STATS_PATH);
+
+    // The children stamp their slots, so the table is mapped before forking
+    if ( sv_init() == -1 )
+        syslog(LOG_WARNING, "supervisor: %m, children are only reaped");
+
+    // Workers forked once multiplex the clients the server hands them
+    if ( _workers >= 0 ) {
+        clientreadfifo = clientwritefifo = -1;
+        if ( wp_run(_workers, _pin, publicfifo, listensock, statsock) == 0 )
+            stop_server();
+        syslog(LOG_ERR, "worker pool: %m");
+        exit(1);
+    }
 
-        // spawn child process to handle this client
-        if ( 0 == fork() ) {  
-            clientwritefifo = -1; 
-            // Client should have opened its rawtext_fd for writing before
-            // sending the message, so the open here should succeed
-	        if ( (clientwritefifo = open(handshk.client_out_fifo, O_RDONLY)) == -1 ) {
-                //fprintf(stderr, "Client did not have pipe open for writing\n");
-                exit(1);
+    // One process multiplexes every client
+    if ( _event_mode ) {
+        clientreadfifo = clientwritefifo = -1;
+        if ( ev_run(publicfifo, listensock, statsock) == 0 )
+            stop_server();
+        syslog(LOG_ERR, "event loop: %m");
+        exit(1);
+    }
+
+    fds[0].fd = publicfifo;
+    fds[1].fd = listensock;  // ignored by poll() when -1
+    fds[2].fd = statsock;
+    fds[0].events = fds[1].events = fds[2].events = POLLIN;
+    while ( 1 ) {
+        if ( (ready = poll(fds, 3, ad_waiting() ? AD_POLL_MS : SV_TICK_MS)) == -1 && errno != EINTR )
+            exit(1);
+        if ( sv_stopping )
+            stop_server();
+        if ( sv_exited ) {
+            sv_exited = 0;
+            _live -= sv_reap();
+        }
+        sv_tick();
+        // sessions that ended make room for the clients waiting
+        while ( ad_dequeue(&client, _live) )
+            start_client(&client);
+        if ( ready == -1 )
+            continue;
+
+        if ( fds[2].revents & POLLIN )
+            st_serve(statsock);
+
+        if ( fds[1].revents & POLLIN ) {
+            if ( (client.fd = accept(listensock, NULL, NULL)) == -1 )
+                continue;
+            client.since = st_now();
+            admit(&client);
+        }
+
+        if ( !(fds[0].revents & POLLIN) )
+            continue;
+        // A hello is written atomically, but several may be waiting
+        if ( tp_fill(&hellos, publicfifo, NULL, 0) <= 0 )
+            break;
+        client.fd = -1;
+        client.since = st_now();
+        while ( (len = tp_next(&hellos, &frame)) != 0 ) {
+            if ( len == -1 ) {
+                syslog(LOG_WARNING, "garbage on %s dropped", PUBLIC);
+                tp_reader_init(&hellos);
+                break;
             }
-            
-	    //initialize the game
-	    init_new_game(&handshk);
-
-	    struct move clients_move, servers_move;
-
-            // Attempt to read from client's raw_text_fifo; block waiting for input
-	        while ( (nbytes = read(clientwritefifo, (char*) &clients_move, sizeof(clients_move))) > 0 ) {
-		     	
-		    tries = 0;
-                // Try 5 times or until client is reading
-                while (((clientreadfifo = open(handshk.client_in_fifo, 
-                         O_WRONLY | O_NDELAY)) == -1 ) && (tries < MAXTRIES )) 
-                {
-                     sleep(1);
-                     tries++;
-                }
-                if ( tries == MAXTRIES ) {
-                    // Failed to open client private FIFO for writing
-                    exit(1);
-                }
+            if ( tp_get_hello(frame, len, &client.hello) == 0 )
+                admit(&client);
+        }
+    }
+    return 0;
+}
 
-		ttt_play(&clients_move, &servers_move);     
+void close_listeners(void)
+{
+    if ( listensock != -1 ) {
+        close(listensock);
+        listensock = -1;
+    }
+    if ( statsock != -1 ) {
+        close(statsock);
+        statsock = -1;
+    }
+}
 
-	        if ( -1 == write(clientreadfifo, (char*) &servers_move, sizeof(struct move)) ) {
-	                if ( errno == EPIPE )
-	                    exit(1);
-	            }
-	            close(clientreadfifo);  // close write-end of private FIFO      
-                clientreadfifo = -1; 
+void admit(struct ad_client* client)
+{
+    if ( ad_admit(client, _live) == AD_ADMIT )
+        start_client(client);
+}
 
-	        }
+void start_client(const struct ad_client* client)
+{
+    const struct handshake* handshk = &client->hello;
+    struct sv_child* slot;
+    struct tp_reader moves;           // frames read from a private FIFO
+    int tries;                        // num tries to open private FIFO
+    pid_t pid;
+
+    // spawn child process to handle this client
+    slot = sv_reserve();
+    if ( 0 == (pid = fork()) ) {
+        start_child(slot);
+        if ( client->fd != -1 ) {
+            socket_session(client->fd, client->since);
             exit(0);
         }
+        clientwritefifo = -1; 
+        // Client should have opened its rawtext_fd for writing before
+        // sending the message, so the open here should succeed
+        if ( (clientwritefifo = tp_open_fifo(handshk->client_out_fifo, O_RDONLY)) == -1 ) {
+            //fprintf(stderr, "Client did not have pipe open for writing\n");
+            exit(1);
+        }
+
+        // The client keeps its private FIFO open for reading for the
+        // whole session, so it is opened once and every reply is one
+        // atomic write of a frame
+        tries = 0;
+        while (((clientreadfifo = tp_open_fifo(handshk->client_in_fifo, 
+                 O_WRONLY | O_NDELAY)) == -1 ) && errno == ENXIO && (tries < MAXTRIES )) 
+        {
+             sleep(1);
+             tries++;
+        }
+        if ( clientreadfifo == -1 ) {
+            // Failed to open client private FIFO for writing
+            exit(1);
+        }
+
+        tp_reader_init(&moves);
+        play_session(handshk, &moves, clientwritefifo, clientreadfifo, NULL, client->since);
+        exit(0);
     }
-    return 0;
+    sv_started(slot, pid);
+    if ( pid != -1 )
+        _live++;
+    if ( client->fd != -1 )
+        close(client->fd);
+}
+
+void start_child(struct sv_child* slot)
+{
+    struct sigaction handler;
+
+    close_listeners();
+    sv_child(slot);
+    _devnull = open("/dev/null", O_RDWR);
+    // the supervisor's SIGTERM ends this session only, and must leave the
+    // public FIFO and the sockets to the server
+    memset(&handler, 0, sizeof(handler));
+    handler.sa_handler = on_expire;
+    sigaction(SIGTERM, &handler, NULL);
+    sigaction(SIGQUIT, &handler, NULL);
+}
+
+void socket_session(int sock, long long since)
+{
+    struct tp_reader r;
+    struct handshake handshk;
+    struct tr_end ring;
+    const unsigned char* frame;
+    int passed[3];  // a bot's shared-memory rings, see tttring.h
+    int len, i;
+
+    // the hello is the first message on the connection
+    tp_reader_init(&r);
+    if ( tp_fill(&r, sock, passed, 3) <= 0 ||
+         (len = tp_next(&r, &frame)) <= 0 || tp_get_hello(frame, len, &handshk) == -1 ) {
+        for ( i = 0; i < 3; i++ )
+            if ( passed[i] != -1 )
+                close(passed[i]);
+        return;
+    }
+    syslog(LOG_INFO, "socket client uid %ld", (long) us_peer_uid(sock));
+    if ( handshk.transport == TRANSPORT_RING && tr_attach(&ring, passed) == 0 ) {
+        play_session(&handshk, &r, sock, sock, &ring, since);
+        tr_close(&ring);
+        return;
+    }
+    for ( i = 0; i < 3; i++ )
+        if ( passed[i] != -1 )
+            close(passed[i]);
+    play_session(&handshk, &r, sock, sock, NULL, since);
+}
+
+void play_session(const struct handshake* hndshk, struct tp_reader* r,
+                  int movefd, int replyfd, struct tr_end* ring, long long since)
+{
+    struct ttt_session session;
+    struct tp_welcome welcome;
+    struct move clients_move, servers_move;
+    unsigned char out[TP_BUFFER];
+    int len, written;
+    long long start;
+
+    if ( session_init(&session, hndshk) == -1 )
+        return;
+    _movefd = movefd;
+
+    // tell the client what it is going to get
+    ttt_welcome(&session, ring ? TRANSPORT_RING : TRANSPORT_STREAM, &welcome);
+    len = tp_put_welcome(out, &welcome);
+    if ( write(replyfd, out, len) != len ) {
+        session_end(&session);
+        _movefd = -1;
+        return;
+    }
+    session_started(&session, ring ? TRANSPORT_RING : TRANSPORT_STREAM, since);
+
+    // the socket only tells when a ring client is gone
+    while ( ring && tr_wait(ring, &clients_move, movefd) ) {
+        sv_active();
+        ttt_play(session_game(&session, 0), &clients_move, &servers_move);
+
+        start = st_on() ? st_now() : 0;
+        if ( tr_push(ring, &servers_move) == -1 )
+            break;  // the client stopped taking replies
+        if ( st_on() )
+            st_time(ST_WRITE_NS, st_now() - start);
+    }
+
+    // Attempt to read from client's raw_text_fifo; block waiting for input.
+    // Every move that came in one read is answered with one write; a child
+    // holds up no other client, so each of them gets the whole budget.
+    while ( !ring ) {
+        if ( (len = session_play(&session, r, out, sizeof(out), 0)) == -1 )
+            break;
+        if ( len > 0 ) {
+            start = st_on() ? st_now() : 0;
+            written = write(replyfd, out, len);
+            if ( st_on() )
+                st_time(ST_WRITE_NS, st_now() - start);
+            if ( -1 == written && errno == EPIPE )
+                break;
+            continue;
+        }
+        if ( tp_fill(r, movefd, NULL, 0) <= 0 )
+            break;
+        sv_active();
+    }
+    session_end(&session);
+    _movefd = -1;
 }
 
 /*****************************************************************************/
 /*                              Signal Handlers                              */
 /*****************************************************************************/
 
+void on_expire( int sig )
+{
+    // Only async-signal-safe calls here: the session is ended by
+    // play_session(), whose next read of a move now finds the end of
+    // /dev/null. shutdown() also wakes a write blocked on a socket client;
+    // one that never returns is left to the SIGKILL SV_KILL_MS later.
+    if ( _movefd == -1 || _devnull == -1 )
+        _exit(0);
+    shutdown(_movefd, SHUT_RDWR);
+    dup2(_devnull, _movefd);
+}
+
 void on_sigchld( int signo )
 {
-    //pid_t pid;
-    //int   status;
-
-    //while ( (pid = waitpid(-1, &status, WNOHANG) ) > 0 )
-        //fprintf(tttlog, "child %d terminated.\n", pid);
-        //fflush(tttlog);
-	;
-    return;
+    // reaped by the main loop, which knows which slots it has filled in;
+    // the signal also wakes it from poll()
+    sv_exited = 1;
 }
 
 void on_sigpipe( int signo )
@@ -221,6 +639,13 @@ void on_sigpipe( int signo )
 }
 
 void on_signal( int sig )
+{
+    // stop_server() runs from the main loop, which poll() or epoll_wait()
+    // returns to with EINTR
+    sv_stopping = 1;
+}
+
+void stop_server(void)
 {
     close(publicfifo);
     close(dummyfifo);
@@ -229,7 +654,16 @@ void on_signal( int sig )
     if ( clientwritefifo != -1)
         close(clientwritefifo);
     unlink(PUBLIC);
-    //fclose(tttlog);
+    if ( listensock != -1 ) {
+        close(listensock);
+        unlink(SOCKET_PATH);
+    }
+    if ( statsock != -1 ) {
+        close(statsock);
+        unlink(STATS_PATH);
+    }
+    gr_flush();
+    lg_stop();
     exit(0);
 }
 
@@ -261,97 +695,5 @@ void daemon_init(const char *pname, int facility)
 	// Close all open file descriptors
 	for (i = 0; i < MAXFD; i++)
 		close(i);
-}
-
-/************************************************************************/
-/*                       Player                                         */
-/************************************************************************/
-void clear_board(){
-	int i,j;
-	for (i=0; i < BOARD_SIZE; i++){
-		for(j=0; j < BOARD_SIZE; j++){
-			_board[i][j] = EMPTY_CELL;
-		}
-	}
-}
-
-void init_new_game(const struct handshake* hndshk){
-	_server_char = hndshk->server_char;
-	_client_char = hndshk->client_char;
-	clear_board();
-}
-
-void ttt_play(struct move* client_mv, struct move* server_mv){
-	if((server_mv->status = validMove(client_mv)) == STATUS_OK) //check if the move can be made
-		_board[client_mv->row][client_mv->col] = _client_char; //place client's char on TTT matrix
-	else return;
-	
-	if((server_mv->status = ttt_status()) == STATUS_OK){ //check again the status
-		counterAttack(server_mv); // if user didnt win, counter attack
-		server_mv->status = ttt_status(); //set servers_move to new status
-	}
-      
-        if(server_mv->status == TIED || server_mv->status == CLIENT_WINS || server_mv->status == SERVER_WINS)
-		clear_board();
-	
-}
-
-int validMove(struct move* client_mv){
-	if( 0 <= client_mv->row && BOARD_SIZE > client_mv->row && 
-		0 <= client_mv->col && BOARD_SIZE > client_mv->col &&
-			_board[client_mv->row][client_mv->col] == EMPTY_CELL)
-				return STATUS_OK;
-	else return INVALID_MOVE;
-}
-
-int ttt_status()
-{
-	int no_empty_cells_left = 1;
-        int i,j; 
-	for (i=0; i < BOARD_SIZE; i++){
-		if(_board[i][0] == _board[i][1] && _board[i][0] == _board[i][2] && _board[i][0] == _server_char)
-			return SERVER_WINS;
-		if(_board[i][0] == _board[i][1] && _board[i][0] == _board[i][2] && _board[i][0] == _client_char)
-			return CLIENT_WINS;
-
-		if(_board[0][i] == _board[1][i] && _board[0][i] == _board[2][i] && _board[0][i] == _server_char)
-			return SERVER_WINS;
-		if(_board[0][i] == _board[1][i] && _board[0][i] == _board[2][i] && _board[0][i] == _client_char)
-			return CLIENT_WINS;
-	}
-
-        if(_board[0][0] == _board[1][1] && _board[0][0] == _board[2][2] && _board[0][0] == _server_char)
-			return SERVER_WINS;
-	if(_board[0][0] == _board[1][1] && _board[0][0] == _board[2][2] && _board[0][0] == _client_char)
-			return CLIENT_WINS;
-
-	if(_board[2][0] == _board[1][1] && _board[2][0] == _board[0][2] && _board[2][0] == _server_char)
-			return SERVER_WINS;
-	if(_board[2][0] == _board[1][1] && _board[2][0] == _board[0][2] && _board[2][0] == _client_char)
-			return CLIENT_WINS;
-	
-	for(i=0; i < BOARD_SIZE; i++)
-		for(j=0; j < BOARD_SIZE; j++)
-			if(_board[i][j] == EMPTY_CELL) return STATUS_OK;
-
-	return TIED;
-	
-
-}
-
-
-void counterAttack(struct move* new_move)
-{
-        int i,j;
-        for (i=0 ; i<BOARD_SIZE; i++){
-                for (j=0; j<BOARD_SIZE; j++){
-                        if (_board[i][j]== EMPTY_CELL) {
-                                _board[i][j] = _server_char;
-				new_move->row = i;
-				new_move->col = j;
-				return;
-                        }
-		}
-	}
-        
+	openlog(pname, LOG_PID, facility);
 }
@@ -0,0 +1,83 @@
+/******************************************************************************
+  Title          : tttslab.c
+  Author         : Andriy Goltsev
+  Description    : Slots, generations and the mapping of a slab
+
+  Notes          : The mapping starts with the free stack and the
+                   generations, then the columns, each rounded up to whole
+                   pages. The free stack is filled so that slot 0 is taken
+                   first, which keeps used low while few records live.
+
+******************************************************************************/
+
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "tttslab.h"
+
+static size_t round_up(size_t n, size_t to)
+{
+	return (n + to - 1) / to * to;
+}
+
+int sl_init(struct sl_slab* slab, unsigned capacity, const size_t* sizes, int columns)
+{
+	size_t page = sysconf(_SC_PAGESIZE), offset, bytes;
+	char* p;
+	int i;
+
+	if (columns > SL_MAX_COLUMNS || capacity == 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	bytes = round_up(capacity * (sizeof(*slab->free) + sizeof(*slab->generation)), page);
+	for (i = 0; i < columns; i++)
+		bytes += round_up(capacity * sizes[i], page);
+	p = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (p == MAP_FAILED)
+		return -1;
+	slab->base = p;
+	slab->bytes = bytes;
+	slab->capacity = capacity;
+	slab->used = 0;
+	slab->free = (unsigned*) p;
+	slab->generation = (uint32_t*) (p + capacity * sizeof(*slab->free));	// zero: all free
+	offset = round_up(capacity * (sizeof(*slab->free) + sizeof(*slab->generation)), page);
+	for (i = 0; i < columns; i++) {
+		slab->column[i] = p + offset;
+		offset += round_up(capacity * sizes[i], page);
+	}
+	for (slab->nfree = 0; slab->nfree < capacity; slab->nfree++)
+		slab->free[slab->nfree] = capacity - 1 - slab->nfree;
+	return 0;
+}
+
+void sl_destroy(struct sl_slab* slab)
+{
+	if (slab->base != NULL)
+		munmap(slab->base, slab->bytes);
+	slab->base = NULL;
+	slab->capacity = slab->used = slab->nfree = 0;
+}
+
+sl_handle sl_alloc(struct sl_slab* slab)
+{
+	unsigned slot;
+
+	if (slab->nfree == 0)
+		return 0;
+	slot = slab->free[--slab->nfree];
+	if (slot >= slab->used)
+		slab->used = slot + 1;
+	return (sl_handle) ++slab->generation[slot] << 32 | slot;
+}
+
+void sl_free(struct sl_slab* slab, sl_handle h)
+{
+	unsigned slot = sl_slot(h);
+
+	slab->generation[slot]++;
+	slab->free[slab->nfree++] = slot;
+	while (slab->used > 0 && !sl_live(slab, slab->used - 1))
+		slab->used--;
+}
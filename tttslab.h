@@ -0,0 +1,80 @@
+/******************************************************************************
+  Title          : tttslab.h
+  Author         : Andriy Goltsev
+  Description    : Fixed-size slab of records with generation-counted handles
+
+  Notes          : A slab holds up to capacity records, laid out as a
+                   struct of arrays: column i is capacity elements of
+                   sizes[i] bytes, and record n is element n of every
+                   column. The fields a loop scans over all the records
+                   go in narrow columns of their own, so the scan reads a
+                   few cache lines instead of every record; the rest of a
+                   record stays in a wide column, whose element type should
+                   be a multiple of SL_LINE. All of it is reserved in one
+                   mapping at sl_init() with MAP_NORESERVE, each column on
+                   pages of its own, and a page costs memory only once a
+                   record on it has been used.
+
+                   sl_alloc() and sl_free() take and return slots on a
+                   stack and never call malloc(); the slot freed last, the
+                   one most likely still in cache, is taken first. Every
+                   slot counts its generation, odd while it is taken. A
+                   handle is the generation and the slot together, so a
+                   handle kept after its record was freed, in an epoll
+                   event of the same batch for example, no longer resolves
+                   even once the slot is taken again. Handle 0 never does.
+
+******************************************************************************/
+
+#ifndef TTTSLAB_H
+#define TTTSLAB_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SL_LINE		64	// cache line
+#define SL_MAX_COLUMNS	8
+
+typedef uint64_t sl_handle;	// generation << 32 | slot
+
+struct sl_slab {
+	unsigned capacity;
+	unsigned used;			// one past the highest slot taken
+	unsigned nfree;			// slots on the free stack
+	unsigned* free;			// the free stack
+	uint32_t* generation;		// by slot, odd while taken
+	void* column[SL_MAX_COLUMNS];
+	void* base;			// the mapping
+	size_t bytes;
+};
+
+//reserves capacity records of the columns of sizes[0 .. columns); returns -1
+//with errno set if it cannot
+int sl_init(struct sl_slab* slab, unsigned capacity, const size_t* sizes, int columns);
+
+//unmaps the slab; its handles and columns are gone
+void sl_destroy(struct sl_slab* slab);
+
+//takes a slot; returns its handle, or 0 if the slab is full. The columns of
+//the slot hold what its last record left there
+sl_handle sl_alloc(struct sl_slab* slab);
+
+//returns the slot of handle h, which must resolve
+void sl_free(struct sl_slab* slab, sl_handle h);
+
+static inline unsigned sl_slot(sl_handle h){
+	return (uint32_t) h;
+}
+
+//1 if slot is taken
+static inline int sl_live(const struct sl_slab* slab, unsigned slot){
+	return slab->generation[slot] & 1;
+}
+
+//1 if h is the handle of a record not freed since
+static inline int sl_resolves(const struct sl_slab* slab, sl_handle h){
+	return sl_slot(h) < slab->capacity && (h >> 32 & 1) &&
+	       slab->generation[sl_slot(h)] == (uint32_t) (h >> 32);
+}
+
+#endif
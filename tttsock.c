@@ -0,0 +1,128 @@
+/******************************************************************************
+  Title          : tttsock.c
+  Author         : Andriy Goltsev
+  Description    : Unix-domain socket transport
+
+******************************************************************************/
+
+#define _GNU_SOURCE	// struct ucred
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "tttsock.h"
+
+static int make_address(const char* path, struct sockaddr_un* addr)
+{
+	if (strlen(path) >= sizeof(addr->sun_path))
+		return -1;
+	memset(addr, 0, sizeof(*addr));
+	addr->sun_family = AF_UNIX;
+	strcpy(addr->sun_path, path);
+	return 0;
+}
+
+int us_listen(const char* path)
+{
+	struct sockaddr_un addr;
+	int fd;
+
+	if (make_address(path, &addr) == -1)
+		return -1;
+	if ((fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0)) == -1)
+		return -1;
+	unlink(path);	// left behind by a server that did not exit cleanly
+	if (bind(fd, (struct sockaddr*) &addr, sizeof(addr)) == -1 ||
+	    listen(fd, US_BACKLOG) == -1) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+int us_connect(const char* path)
+{
+	struct sockaddr_un addr;
+	int fd;
+
+	if (make_address(path, &addr) == -1)
+		return -1;
+	if ((fd = socket(AF_UNIX, SOCK_SEQPACKET, 0)) == -1)
+		return -1;
+	if (connect(fd, (struct sockaddr*) &addr, sizeof(addr)) == -1) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+uid_t us_peer_uid(int fd)
+{
+	struct ucred cred;
+	socklen_t len = sizeof(cred);
+
+	if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) == -1)
+		return (uid_t) -1;
+	return cred.uid;
+}
+
+int us_send_fds(int fd, const void* buf, int len, const int* fds, int nfds)
+{
+	char control[CMSG_SPACE(US_MAX_FDS * sizeof(int))];
+	struct msghdr msg;
+	struct cmsghdr* cmsg;
+	struct iovec iov;
+
+	if (nfds > US_MAX_FDS)
+		return -1;
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base = (void*) buf;
+	iov.iov_len = len;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	if (nfds > 0) {
+		msg.msg_control = control;
+		msg.msg_controllen = CMSG_SPACE(nfds * sizeof(int));
+		cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(nfds * sizeof(int));
+		memcpy(CMSG_DATA(cmsg), fds, nfds * sizeof(int));
+	}
+	return sendmsg(fd, &msg, 0);
+}
+
+int us_recv_fds(int fd, void* buf, int len, int* fds, int nfds)
+{
+	char control[CMSG_SPACE(US_MAX_FDS * sizeof(int))];
+	struct msghdr msg;
+	struct cmsghdr* cmsg;
+	struct iovec iov;
+	int i, n, got;
+
+	for (i = 0; i < nfds; i++)
+		fds[i] = -1;
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base = buf;
+	iov.iov_len = len;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+	if ((n = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC)) == -1)
+		return -1;
+	for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+		if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+			continue;
+		got = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+		for (i = 0; i < got; i++) {
+			int passed = ((int*) CMSG_DATA(cmsg))[i];
+
+			if (i < nfds && fds[i] == -1)
+				fds[i] = passed;
+			else
+				close(passed);	// more than the caller asked for
+		}
+	}
+	return n;
+}
@@ -0,0 +1,40 @@
+/******************************************************************************
+  Title          : tttsock.h
+  Author         : Andriy Goltsev
+  Description    : Unix-domain socket transport
+
+  Notes          : An alternative to the FIFOs for clients on the same host.
+                   The server listens on SOCKET_PATH (ttt.h) with a
+                   SOCK_SEQPACKET socket; a client connects, sends its
+                   hello (tttproto.h, without FIFO names) as one message and
+                   then plays on the connection. Message boundaries are
+                   kept, so a frame is never split, and no per-client
+                   filesystem object is created.
+
+******************************************************************************/
+
+#ifndef TTTSOCK_H
+#define TTTSOCK_H
+
+#include <sys/types.h>
+
+#define US_BACKLOG	128
+#define US_MAX_FDS	4	// descriptors passed with one message
+
+//binds and listens on path, replacing a stale socket; returns the fd or -1
+int us_listen(const char* path);
+
+//connects to the server listening on path; returns the fd or -1
+int us_connect(const char* path);
+
+//user id of the process on the other end of fd, or (uid_t) -1
+uid_t us_peer_uid(int fd);
+
+//sends len bytes of buf as one message together with nfds descriptors
+int us_send_fds(int fd, const void* buf, int len, const int* fds, int nfds);
+
+//receives one message into buf; up to nfds descriptors that came with it
+//are stored in fds, the rest of fds is set to -1. Returns as read()
+int us_recv_fds(int fd, void* buf, int len, int* fds, int nfds);
+
+#endif
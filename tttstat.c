@@ -0,0 +1,64 @@
+/******************************************************************************
+  Title          : tttstat.c
+  Author         : Andriy Goltsev
+  Description    : Prints the counters of a running tttserver
+
+  Build with     : make tttstat
+
+  Usage          : tttstat [-w seconds]
+                   Connects to STATS_PATH and prints the report of the
+                   server (see tttstats.h): uptime, handshakes, active
+                   games, moves, invalid moves and outcomes, then the
+                   count, mean, p50, p99, p999 and max of the handshake,
+                   think and reply write times in nanoseconds. With -w the
+                   report is printed again every that many seconds.
+
+******************************************************************************/
+
+#include "ttt.h"
+#include "tttsock.h"
+#include "tttstats.h"
+
+//prints one report; returns 0 or -1
+static int print_report(void)
+{
+	char report[ST_REPORT_BYTES];
+	int fd, len;
+
+	if ((fd = us_connect(STATS_PATH)) == -1) {
+		perror(STATS_PATH);
+		return -1;
+	}
+	len = read(fd, report, sizeof(report));
+	close(fd);
+	if (len <= 0) {
+		fprintf(stderr, "%s: no report\n", STATS_PATH);
+		return -1;
+	}
+	fwrite(report, 1, len, stdout);
+	fflush(stdout);
+	return 0;
+}
+
+int main(int argc, char* argv[])
+{
+	int opt, interval = 0;
+
+	while ((opt = getopt(argc, argv, "w:")) != -1) {
+		switch (opt) {
+			case 'w': interval = atoi(optarg); break;
+			default:
+				fprintf(stderr, "usage: %s [-w seconds]\n", argv[0]);
+				exit(1);
+		}
+	}
+	if (print_report() == -1)
+		exit(1);
+	while (interval > 0) {
+		sleep(interval);
+		printf("\n");
+		if (print_report() == -1)
+			exit(1);
+	}
+	return 0;
+}
@@ -0,0 +1,121 @@
+/******************************************************************************
+  Title          : tttstats.c
+  Author         : Andriy Goltsev
+  Description    : Counters and latency histograms of the server
+
+******************************************************************************/
+
+#define _GNU_SOURCE	// sched_getcpu()
+#include <sched.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include "tttstats.h"
+
+#define ST_CACHE_LINE	64
+
+struct st_slot {
+	_Alignas(ST_CACHE_LINE) int64_t counter[ST_COUNTERS];
+	_Alignas(ST_CACHE_LINE) struct ttt_hist histogram[ST_HISTOGRAMS];
+};
+
+struct st_slot* st_slots;
+static int _nslots;
+static long long _started;
+
+static const char* _counter_names[ST_COUNTERS] = {
+	"handshakes", "games_active", "moves", "invalid_moves",
+	"client_wins", "server_wins", "ties", "timeouts", "fifos_removed",
+	"queued", "busy"
+};
+
+static const char* _histogram_names[ST_HISTOGRAMS] = {
+	"handshake_ns", "think_ns", "write_ns", "session_cpu_ns", "session_kb"
+};
+
+long long st_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+int st_init(void)
+{
+	long cpus = sysconf(_SC_NPROCESSORS_CONF);
+	void* p;
+
+	_nslots = cpus < 1 ? 1 : cpus > ST_MAX_SLOTS ? ST_MAX_SLOTS : cpus;
+	// zero filled; the pages of CPUs that never count are never touched
+	p = mmap(NULL, _nslots * sizeof(struct st_slot), PROT_READ | PROT_WRITE,
+		 MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED)
+		return -1;
+	st_slots = p;
+	_started = st_now();
+	return 0;
+}
+
+static struct st_slot* my_slot(void)
+{
+	int cpu = sched_getcpu();
+
+	return &st_slots[cpu < 0 ? 0 : cpu % _nslots];
+}
+
+void st_count(enum st_counter counter, long delta)
+{
+	if (st_slots != NULL)
+		__atomic_add_fetch(&my_slot()->counter[counter], delta, __ATOMIC_RELAXED);
+}
+
+void st_time(enum st_histogram histogram, uint64_t ns)
+{
+	if (st_slots != NULL)
+		hs_add_shared(&my_slot()->histogram[histogram], ns);
+}
+
+int st_report(char* buf, int size)
+{
+	struct ttt_hist sum;
+	int64_t total;
+	int i, s, len;
+
+	if (st_slots == NULL)
+		return snprintf(buf, size, "stats off\n");
+	len = snprintf(buf, size, "uptime_s %lld\n", (st_now() - _started) / 1000000000LL);
+	for (i = 0; i < ST_COUNTERS && len < size; i++) {
+		for (s = 0, total = 0; s < _nslots; s++)
+			total += __atomic_load_n(&st_slots[s].counter[i], __ATOMIC_RELAXED);
+		len += snprintf(buf + len, size - len, "%s %lld\n", _counter_names[i], (long long) total);
+	}
+	for (i = 0; i < ST_HISTOGRAMS && len < size; i++) {
+		hs_clear(&sum);
+		for (s = 0; s < _nslots; s++)
+			hs_merge(&sum, &st_slots[s].histogram[i]);
+		len += snprintf(buf + len, size - len,
+				"%s count %llu mean %llu p50 %llu p99 %llu p999 %llu max %llu\n",
+				_histogram_names[i], (unsigned long long) sum.n,
+				(unsigned long long) (sum.n ? sum.sum / sum.n : 0),
+				(unsigned long long) hs_percentile(&sum, 0.5),
+				(unsigned long long) hs_percentile(&sum, 0.99),
+				(unsigned long long) hs_percentile(&sum, 0.999),
+				(unsigned long long) sum.max);
+	}
+	return len < size ? len : size - 1;
+}
+
+void st_serve(int listensock)
+{
+	char report[ST_REPORT_BYTES];
+	int fd, len;
+
+	while ((fd = accept4(listensock, NULL, NULL, SOCK_CLOEXEC)) != -1) {
+		len = st_report(report, sizeof(report));
+		send(fd, report, len, MSG_DONTWAIT | MSG_NOSIGNAL);
+		close(fd);
+	}
+}
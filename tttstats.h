@@ -0,0 +1,82 @@
+/******************************************************************************
+  Title          : tttstats.h
+  Author         : Andriy Goltsev
+  Description    : Counters and latency histograms of the server
+
+  Notes          : st_init() maps one shared, anonymous region before the
+                   server forks, so the children of the fork mode count
+                   into the same place as the parent that reports. The
+                   region has a slot per CPU, each on its own cache lines,
+                   and a process adds to the slot of the CPU it runs on
+                   with relaxed atomic operations: no locks, and no cache
+                   line moves between cores while the counts go up.
+                   st_report() adds the slots up when asked.
+
+                   The report is text, one "name value" line per counter
+                   and one line per histogram. The server sends it to
+                   anyone who connects to STATS_PATH; tttstat reads it.
+                   Before st_init(), or if it failed, nothing is counted.
+
+******************************************************************************/
+
+#ifndef TTTSTATS_H
+#define TTTSTATS_H
+
+#include <stdint.h>
+#include "ttthist.h"
+
+#define STATS_PATH	"/tmp/TICTACTOE_AGOLTSEV.stats"
+#define ST_MAX_SLOTS	64	// CPUs above share the slots
+#define ST_REPORT_BYTES	4096	// the longest report
+
+enum st_counter {
+	ST_HANDSHAKES,
+	ST_GAMES_ACTIVE,	// goes down when a session ends
+	ST_MOVES,		// client moves received
+	ST_INVALID_MOVES,	// answered INVALID_MOVE or INVALID_BOARD
+	ST_CLIENT_WINS,
+	ST_SERVER_WINS,
+	ST_TIES,
+	ST_TIMEOUTS,		// sessions ended by the supervisor (tttsuper.h)
+	ST_FIFOS_REMOVED,	// orphaned private FIFOs
+	ST_QUEUED,		// clients that waited for a session to end (tttadmit.h)
+	ST_BUSY,		// clients turned away
+	ST_COUNTERS
+};
+
+enum st_histogram {
+	ST_HANDSHAKE_NS,	// hello received to welcome written
+	ST_THINK_NS,		// counterAttack()
+	ST_WRITE_NS,		// writing the replies to one read
+	ST_SESSION_CPU_NS,	// CPU time of a session (its process's in the fork mode)
+	ST_SESSION_KB,		// memory of a session (peak RSS of its process)
+	ST_HISTOGRAMS
+};
+
+extern struct st_slot* st_slots;	// NULL while stats are off
+
+//maps the shared region; returns -1 if it cannot
+int st_init(void);
+
+static inline int st_on(void)
+{
+	return st_slots != NULL;
+}
+
+//CLOCK_MONOTONIC in nanoseconds
+long long st_now(void);
+
+//adds delta to a counter
+void st_count(enum st_counter counter, long delta);
+
+//adds one value to a histogram
+void st_time(enum st_histogram histogram, uint64_t ns);
+
+//writes the report to buf; returns its length
+int st_report(char* buf, int size);
+
+//sends the report, as one message, to every client waiting on the
+//non-blocking listening socket listensock
+void st_serve(int listensock);
+
+#endif
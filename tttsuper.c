@@ -0,0 +1,201 @@
+/******************************************************************************
+  Title          : tttsuper.c
+  Author         : Andriy Goltsev
+  Description    : Table of the children, reaping and the FIFO sweep
+
+  Notes          : A slot is free with pid 0 and reserved with pid -1
+                   between sv_reserve() and sv_started(); only the server
+                   writes pid, started and signalled, only the child
+                   writes active. _used is one past the highest slot taken
+                   since the table last emptied, so the scans stay short
+                   while few children run.
+
+******************************************************************************/
+
+#define _GNU_SOURCE	// wait4()
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <syslog.h>
+#include "tttsuper.h"
+#include "tttstats.h"
+
+struct sv_child {
+	pid_t pid;		// 0: free, -1: being forked
+	long long started;	// ms
+	long long active;	// ms, stamped by the child
+	long long signalled;	// ms when SIGTERM went out, 0 before
+};
+
+long sv_idle_ms = SV_IDLE_S * 1000L;
+long sv_session_ms = SV_SESSION_S * 1000L;
+volatile sig_atomic_t sv_exited;
+volatile sig_atomic_t sv_stopping;
+
+static struct sv_child* _table;		// shared with the children
+static int _used;
+static struct sv_child* _mine;		// a child's own slot
+static long long _last_tick, _last_sweep;
+
+long long sv_now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+	return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+int sv_init(void)
+{
+	void* p;
+
+	p = mmap(NULL, SV_MAX_CHILDREN * sizeof(struct sv_child), PROT_READ | PROT_WRITE,
+		 MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED)
+		return -1;
+	_table = p;
+	_last_tick = _last_sweep = sv_now_ms();
+	return 0;
+}
+
+struct sv_child* sv_reserve(void)
+{
+	struct sv_child* c;
+	int i;
+
+	if (_table == NULL)
+		return NULL;
+	for (i = 0; i < SV_MAX_CHILDREN && _table[i].pid != 0; i++)
+		;
+	if (i == SV_MAX_CHILDREN)
+		return NULL;
+	if (i >= _used)
+		_used = i + 1;
+	c = &_table[i];
+	c->pid = -1;
+	c->started = c->active = sv_now_ms();
+	c->signalled = 0;
+	return c;
+}
+
+void sv_started(struct sv_child* c, pid_t pid)
+{
+	if (c != NULL)
+		c->pid = pid == -1 ? 0 : pid;
+}
+
+void sv_child(struct sv_child* c)
+{
+	_mine = c;
+}
+
+void sv_active(void)
+{
+	if (_mine != NULL)
+		__atomic_store_n(&_mine->active, sv_now_ms(), __ATOMIC_RELAXED);
+}
+
+int sv_reap(void)
+{
+	struct rusage ru;
+	pid_t pid;
+	int i, status, reaped = 0;
+
+	while ((pid = wait4(-1, &status, WNOHANG, &ru)) > 0) {
+		reaped++;
+		st_time(ST_SESSION_CPU_NS,
+			(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000000ULL +
+			(ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1000ULL);
+		st_time(ST_SESSION_KB, ru.ru_maxrss);
+		for (i = 0; i < _used; i++)
+			if (_table[i].pid == pid) {
+				_table[i].pid = 0;
+				break;
+			}
+	}
+	while (_used > 0 && _table[_used - 1].pid == 0)
+		_used--;
+	return reaped;
+}
+
+int sv_expired(long long started_ms, long long active_ms, long long now_ms)
+{
+	return (sv_idle_ms > 0 && now_ms - active_ms >= sv_idle_ms) ||
+	       (sv_session_ms > 0 && now_ms - started_ms >= sv_session_ms);
+}
+
+void sv_tick(void)
+{
+	struct sv_child* c;
+	long long now = sv_now_ms();
+	int i;
+
+	if (now - _last_tick < SV_TICK_MS)
+		return;
+	_last_tick = now;
+	for (i = 0; i < _used; i++) {
+		c = &_table[i];
+		if (c->pid <= 0)
+			continue;
+		if (c->signalled) {
+			if (now - c->signalled >= SV_KILL_MS)
+				kill(c->pid, SIGKILL);	// reaped like any other
+		}
+		else if (sv_expired(c->started, __atomic_load_n(&c->active, __ATOMIC_RELAXED), now)) {
+			kill(c->pid, SIGTERM);
+			c->signalled = now;
+			st_count(ST_TIMEOUTS, 1);
+		}
+	}
+	sv_sweep(now);
+}
+
+//1 if the FIFO at name in dir has no reader and has not been used lately
+static int orphaned(int dir, const char* name, time_t now)
+{
+	struct stat st;
+	int fd;
+
+	if (fstatat(dir, name, &st, AT_SYMLINK_NOFOLLOW) == -1 || !S_ISFIFO(st.st_mode) ||
+	    now - st.st_mtime < SV_FIFO_AGE_S)
+		return 0;
+	// without a reader a non-blocking open for writing fails with ENXIO
+	if ((fd = openat(dir, name, O_WRONLY | O_NONBLOCK | O_CLOEXEC)) != -1) {
+		close(fd);
+		return 0;
+	}
+	return errno == ENXIO;
+}
+
+int sv_sweep(long long now_ms)
+{
+	struct dirent* e;
+	DIR* d;
+	time_t now = time(NULL);
+	int removed = 0;
+
+	if (now_ms - _last_sweep < SV_SWEEP_S * 1000LL)
+		return 0;
+	_last_sweep = now_ms;
+	if ((d = opendir("/tmp")) == NULL)
+		return 0;
+	while ((e = readdir(d)) != NULL)
+		if (strncmp(e->d_name, SV_FIFO_PREFIX, strlen(SV_FIFO_PREFIX)) == 0 &&
+		    orphaned(dirfd(d), e->d_name, now) && unlinkat(dirfd(d), e->d_name, 0) == 0)
+			removed++;
+	closedir(d);
+	if (removed > 0) {
+		st_count(ST_FIFOS_REMOVED, removed);
+		syslog(LOG_INFO, "%d orphaned FIFOs removed from /tmp", removed);
+	}
+	return removed;
+}
@@ -0,0 +1,82 @@
+/******************************************************************************
+  Title          : tttsuper.h
+  Author         : Andriy Goltsev
+  Description    : Supervision of the sessions: reaping, timeouts, cleanup
+
+  Notes          : In the fork mode the server keeps a table of its
+                   children in memory shared with them. A child stamps its
+                   slot with the coarse monotonic clock whenever a move
+                   comes in, a plain store and no system call. Once per
+                   SV_TICK_MS the server looks at the table: a child idle
+                   for longer than sv_idle_ms, or alive for longer than
+                   sv_session_ms, gets SIGTERM, and SIGKILL if it is still
+                   there SV_KILL_MS later. Children are reaped from the
+                   server's loop, never from the SIGCHLD handler, so a
+                   slot is never freed before it is filled in; their CPU
+                   time and peak resident size go into the session_cpu_ns
+                   and session_kb histograms of tttstats.h. The event loop
+                   (tttevent.h) applies the same limits to its sessions
+                   itself and accounts the time it spends on each and the
+                   memory it held.
+
+                   Every SV_SWEEP_S the server also removes the /tmp/fifo_*
+                   FIFOs that nobody reads and that have not been used for
+                   SV_FIFO_AGE_S, left behind by clients that crashed.
+
+******************************************************************************/
+
+#ifndef TTTSUPER_H
+#define TTTSUPER_H
+
+#include <signal.h>
+#include <sys/types.h>
+
+#define SV_IDLE_S	600		// default idle limit of a session
+#define SV_SESSION_S	86400		// default duration limit of a session
+#define SV_TICK_MS	1000
+#define SV_KILL_MS	5000
+#define SV_MAX_CHILDREN	4096		// supervised at once; more are only reaped
+#define SV_FIFO_PREFIX	"fifo_"		// of the private FIFOs in /tmp
+#define SV_SWEEP_S	60
+#define SV_FIFO_AGE_S	300
+
+struct sv_child;
+
+extern long sv_idle_ms, sv_session_ms;		// 0: no limit
+extern volatile sig_atomic_t sv_exited;		// set by the SIGCHLD handler
+extern volatile sig_atomic_t sv_stopping;	// set by SIGTERM: the loops return
+
+//maps the table of children; returns -1 if it cannot
+int sv_init(void);
+
+//CLOCK_MONOTONIC_COARSE in milliseconds
+long long sv_now_ms(void);
+
+//takes a slot for a child about to be forked; NULL if the table is full
+struct sv_child* sv_reserve(void);
+
+//in the server: the child of slot c is pid, or the fork failed (-1)
+void sv_started(struct sv_child* c, pid_t pid);
+
+//in the child: c is its slot (may be NULL)
+void sv_child(struct sv_child* c);
+
+//in the child: a move came in
+void sv_active(void);
+
+//collects the children that have exited and accounts their resources;
+//returns how many
+int sv_reap(void);
+
+//signals the children past their limits and sweeps the FIFOs; does
+//nothing until SV_TICK_MS after the last time
+void sv_tick(void);
+
+//removes the orphaned /tmp/fifo_* FIFOs every SV_SWEEP_S; returns how many
+int sv_sweep(long long now_ms);
+
+//1 if a session that started at started_ms and last moved at active_ms is
+//past the limits at now_ms
+int sv_expired(long long started_ms, long long active_ms, long long now_ms);
+
+#endif